@@ -27,12 +27,19 @@
 #endif
 
 #include <SoftI2CMaster.h>
+#include <SoftI2CShadow.h>
 #include <avr/io.h>
 
 
 #define BMAADDR 0x70
 #define LEDPIN 13
 
+// range & bandwidth register, the upper 3 bits are reserved and must not be changed
+#define RANGEREG 0x14
+#define RANGE_2G (0<<3)
+#define BW_100HZ 2
+I2CShadow<1> bmaConfig(BMAADDR, RANGEREG);
+
 int xval, yval, zval;
 
 void CPUSlowDown(int fac) {
@@ -80,7 +87,8 @@ boolean initBma(void)
 {
   if (!setControlBits(B00000010)) return false;;
   delay(100);
-  return true;
+  bmaConfig.invalidate(); // the soft reset restored the default values
+  return bmaConfig.update(RANGEREG, 0x1F, RANGE_2G | BW_100HZ);
 }
 
 int readOneVal(boolean last)
@@ -22,6 +22,7 @@
 //#define I1C_NOINTERRUPT 1 // no interrupts
 //#define I2C_CPUFREQ (F_CPU/8) // slow down CPU frequency
 #include <SoftI2CMaster.h>
+#include <SoftI2CStream.h>
 
 #define EEPROMADDR 0xA6 // set by jumper (A0 and A1 = High)
 #define MAXADDR 0x1FFFF
@@ -79,6 +80,53 @@ boolean readBurstEEPROM(unsigned long start, unsigned long stop) {
   return true;
 }
 
+//------------------------------------------------------------------------------
+/*
+ * Print sink that lists each byte with its address on Serial. It tells
+ * i2c_read_stream that it would block as long as the serial TX buffer
+ * has no room for a complete line.
+ */
+class EepromLister : public Print {
+public:
+  EepromLister(unsigned long start) : addr(start) { }
+  size_t write(uint8_t byte) {
+    Serial.print(addr++,HEX);
+    Serial.print(F(": "));
+    if (byte < 0x10) Serial.print("0");
+    Serial.println(byte,HEX);
+    return 1;
+  }
+  int availableForWrite(void) {
+    return (Serial.availableForWrite() >= 11 ? 1 : 0); // "1FFFF: XX\r\n"
+  }
+private:
+  unsigned long addr;
+};
+
+//------------------------------------------------------------------------------
+/* 
+ * list memory range, reading the EEPROM while Serial is transmitting
+ */
+boolean listEEPROM(unsigned long from, unsigned long to) {
+  EepromLister lister(from);
+  unsigned long blockend;
+
+  while (from <= to) {
+    // a sequential read cannot cross the border between the two 64k blocks
+    blockend = from | 0xFFFF;
+    if (blockend > to) blockend = to;
+    // and the length of i2c_read_stream is a 16-bit size_t
+    if (blockend - from > 0xFFFE) blockend = from + 0xFFFE;
+    if (!i2c_start(EEPROMADDR | I2C_WRITE | (from&0x10000 ? 8 : 0) )) return false;
+    if (!i2c_write((from>>8)&0xFF)) return false;
+    if (!i2c_write(from&0xFF)) return false;
+    if (!i2c_rep_start(EEPROMADDR | I2C_READ | (from&0x10000 ? 8 : 0) )) return false;
+    i2c_read_stream(lister, blockend-from+1);
+    i2c_stop();
+    from = blockend+1;
+  }
+  return true;
+}
 
 //------------------------------------------------------------------------------
 
@@ -300,15 +348,8 @@ void loop(void) {
     addr = parseHex();
     Serial.print(F("to addr: "));
     toaddr = parseHex();
-    while (addr <= toaddr) {
-      noterror = readEEPROM(addr,&byte);
-      Serial.print(addr,HEX);
-      Serial.print(F(": "));
-      if (byte < 0x10) Serial.print("0");
-      Serial.println(byte,HEX);
-      if (!noterror) Serial.println(F("Error while reading"));
-      addr++;
-    }
+    noterror = listEEPROM(addr,toaddr);
+    if (!noterror) Serial.println(F("Error while reading"));
     break;
   case 'p': 
     noterror = performanceTest();
@@ -1,7 +1,23 @@
 // Sketch to fill up EEPROM, sent from the Perl script sendfiles.pl
-// Sendbytes sends whole files with the size always as the first number
-// Receivebytes stores these chunks in EEPROM and stores in the first
-// 256 bytes a table of 64 (unsigned long) addresses to these chunks.
+// Sendfiles sends whole files in binary frames of at most one EEPROM page.
+// Receivebytes stores these files in EEPROM and stores in the first
+// 256 bytes a table of 64 (unsigned long) addresses to these files
+// (the entry after the last file is the end address).
+//
+// Frames sent by the host:
+//   STX seq type len data[len] crc_hi crc_lo
+//   seq: sequence number (mod 256), type: 'D' = data, 'E' = end of file,
+//   'Z' = end of transfer, len: 0..128, data frames must not cross an
+//   EEPROM page boundary, crc: CRC-16 (XMODEM) over seq ... data
+// Replies of the device (followed by the complement of seq/err as a check):
+//   ACK seq: all frames up to seq are stored in EEPROM (sent only after the
+//            write cycle of the page has finished)
+//   NAK seq: a frame was damaged or lost, resend starting with seq
+//   CAN err: fatal error (see ERR_* below), transfer aborted
+// The host may send one frame ahead of the last ACK, so that the next
+// frame is received while the EEPROM is busy with the write cycle of the
+// last one. Since the serial input is also read between the bytes of a
+// page write, no input is lost even at high baud rates.
 
 #ifdef __AVR_ATmega328P__
 /* Corresponds to A4/A5 - the hardware I2C pins on Arduinos */
@@ -23,134 +39,249 @@
 // #define I1C_NOINTERRUPT 1 // no interrupts
 // #define I2C_CPUFREQ (F_CPU/8) // slow down CPU frequency
 #include <SoftI2CMaster.h>
+#include <util/crc16.h>
 
 #define EEPROMADDR 0xA6 // set by jumper (A1=1 and A0=1)
 #define MAXADDR 0x1FFFF
+#define PAGESIZE 128
+#define BAUD 115200 // has to be the same in sendfiles.pl
+#define FRAMETIMEOUT 100 // msec between two bytes of a frame
+
+#define STX 0x02
+#define ACK 0x06
+#define NAK 0x15
+#define CAN 0x18
+
+#define ERR_FULL  1 // EEPROM full
+#define ERR_FILES 2 // more than 63 files
+#define ERR_I2C   3 // EEPROM does not respond
+#define ERR_FRAME 4 // data frame crosses a page boundary
+#define ERR_TYPE  5 // unknown frame type
+
+// states of the receiver
+#define RX_IDLE 0
+#define RX_SEQ  1
+#define RX_TYPE 2
+#define RX_LEN  3
+#define RX_DATA 4
+#define RX_CRC1 5
+#define RX_CRC2 6
+
+struct frame_t {
+  uint8_t seq, type, len;
+  uint8_t data[PAGESIZE];
+};
+
+frame_t frame[2];  // one is received while the other one is written
+uint8_t rx = 0;     // frame currently received
+uint8_t rxstate = RX_IDLE, rxcount;
+int8_t rxresult = 0; // 1 = frame complete, -1 = damaged frame, 0 = not yet
+uint16_t crc, rxcrc;
+unsigned long rxtime;
 
 long unsigned startaddrs[64];
 long unsigned addr = 0;
-boolean newpage = true;
-
-boolean writeEEPROM(uint8_t byte) {
-  if (newpage) {
-    // issue a start condition, send device address and write direction bit
-    i2c_start_wait(EEPROMADDR | I2C_WRITE | (addr&0x10000 ? 8 : 0));
-    newpage = false;
-    // send the address
-    if (!i2c_write((addr>>8)&0xFF)) return false;
-    if (!i2c_write(addr&0xFF)) return false;
-  }
-  // send data to EEPROM
-  if (!i2c_write(byte)) return false;
-  addr++;
+uint8_t files = 0;
+boolean pending = false; // a page write cycle has not been acknowledged yet
+uint8_t pendseq, penddev;
+
+// read the available serial input into the frame buffer; called
+// whenever there is time, in particular between the bytes of a page write
+void receive(void)
+{
+  frame_t *f = &frame[rx];
+  uint8_t c;
 
-  if (addr%128 == 0) {
-    // if add points to new page, save the old one!
-    finishEEPage();
+  if (rxresult) return; // the last frame has not been handled yet
+  if (rxstate != RX_IDLE && millis() - rxtime > FRAMETIMEOUT) {
+    rxstate = RX_IDLE;
+    rxresult = -1;
+    return;
+  }
+  while (Serial.available()) {
+    c = Serial.read();
+    rxtime = millis();
+    if (rxstate >= RX_SEQ && rxstate <= RX_DATA) crc = _crc_xmodem_update(crc, c);
+    switch (rxstate) {
+    case RX_IDLE:
+      if (c == STX) {
+	crc = 0;
+	rxstate = RX_SEQ;
+      }
+      break;
+    case RX_SEQ:
+      f->seq = c;
+      rxstate = RX_TYPE;
+      break;
+    case RX_TYPE:
+      f->type = c;
+      rxstate = RX_LEN;
+      break;
+    case RX_LEN:
+      if (c > PAGESIZE) {
+	rxstate = RX_IDLE;
+	rxresult = -1;
+	return;
+      }
+      f->len = c;
+      rxcount = 0;
+      rxstate = (c ? RX_DATA : RX_CRC1);
+      break;
+    case RX_DATA:
+      f->data[rxcount++] = c;
+      if (rxcount == f->len) rxstate = RX_CRC1;
+      break;
+    case RX_CRC1:
+      rxcrc = c << 8;
+      rxstate = RX_CRC2;
+      break;
+    case RX_CRC2:
+      rxstate = RX_IDLE;
+      rxresult = ((rxcrc | c) == crc ? 1 : -1);
+      return;
+    }
   }
-  return true;
 }
 
-void finishEEPage(void)
+void reply(uint8_t code, uint8_t val)
 {
-  i2c_stop();
-  newpage = true;
+  Serial.write(code);
+  Serial.write(val);
+  Serial.write(~val);
 }
 
-int convHexDigit(char c) 
+void fail(uint8_t err)
 {
-  if (c >= '0' && c <= '9') return (c - '0');
-  else if (c >= 'A' && c <= 'F') return(c - 'A' + 10);
-  else return (-99);
+  reply(CAN, err);
+  while (1) { };
 }
 
-int convHex(char c1, char c2)
+// write <len> bytes (not crossing a page boundary) to addr
+boolean writePage(const uint8_t *data, uint8_t len)
 {
-  int i1 = convHexDigit(c1);
-  int i2 = convHexDigit(c2);
-  if (i1 < 0 || i2 < 0) return -99;
-  else return (i1*16+i2);
-}
+  boolean ok;
 
-
-int readNextByte(void)
-{
-  char c1 = '\0';
-  char c2;
-  while (c1 == '\0') {
-    while (!Serial.available()) { };
-    c1 = Serial.read();
-    if (c1 <= ' ') c1 = '\0';
+  penddev = EEPROMADDR | I2C_WRITE | (addr&0x10000 ? 8 : 0);
+  i2c_start_wait(penddev);
+  ok = i2c_write((addr>>8)&0xFF) && i2c_write(addr&0xFF);
+  for (uint8_t i = 0; ok && i < len; i++) {
+    ok = i2c_write(data[i]);
+    receive();
   }
-  while (!Serial.available()) { };
-  c2 = Serial.read();
-  if (c1 == 'X' && c2 == 'X') return -1;
-  if (c1 == 'Z' && c2 == 'Z') return -2;
+  i2c_stop(); // starts the write cycle
+  addr += len;
+  return ok;
+}
 
-  return convHex(c1,c2);
+// wait for the end of the write cycle and acknowledge the frame
+void commit(void)
+{
+  if (!pending) return;
+  i2c_start_wait(penddev); // acknowledge polling
+  i2c_stop();
+  reply(ACK, pendseq);
+  pending = false;
 }
 
+void writeTable(void)
+{
+  uint8_t buf[PAGESIZE];
 
+  addr = 0;
+  for (uint8_t page = 0; page < 2; page++) {
+    for (uint8_t i = 0; i < PAGESIZE/4; i++) {
+      long unsigned a = startaddrs[page*PAGESIZE/4 + i];
+      buf[4*i] = (a>>24)&0xFF;
+      buf[4*i+1] = (a>>16)&0xFF;
+      buf[4*i+2] = (a>>8)&0xFF;
+      buf[4*i+3] = a&0xFF;
+    }
+    if (!writePage(buf, PAGESIZE)) fail(ERR_I2C);
+  }
+  i2c_start_wait(penddev);
+  i2c_stop();
+}
 
 //------------------------------------------------------------------------------
 
 void setup(void)
 {
-  Serial.begin(19200);
+  Serial.begin(BAUD);
   Serial.println("XXX");
 }
 
 void loop(void)
 {
-  boolean ready = false;
-  int byte;
-  int chunk = 0;
-  int counter;
-  
-  addr=0;
-  for (int i=0; i< 256; i++) writeEEPROM(0xFF);
-  Serial.setTimeout(5000);
-  startaddrs[chunk++] = addr;
-  counter = 0;
+  boolean ready = false, nakked = false;
+  uint8_t expect = 0;
+  int8_t result;
+  frame_t *f;
+  uint8_t empty[PAGESIZE];
+
+  memset(empty, 0xFF, PAGESIZE);
+  addr = 0;
+  if (!writePage(empty, PAGESIZE) || !writePage(empty, PAGESIZE)) fail(ERR_I2C);
+  startaddrs[files] = addr;
   while (!ready) {
-    byte = readNextByte();
-    if (byte < 0) {
-      switch (byte) {
-      case -99:
-	Serial.print("Num error\n"); 
-	while (1) { };
-	break;
-      case -1:
-	finishEEPage();
-	Serial.println("ZZZ");
-	startaddrs[chunk++] = addr;
-	counter = 0;
-	break;
-      case -2:
-	Serial.println("ZZ seen");
-	ready = true;
-	break;
+    receive();
+    if (rxresult == 0) {
+      if (pending && !Serial.available()) { // has the write cycle finished?
+	if (i2c_start(penddev)) {
+	  reply(ACK, pendseq);
+	  pending = false;
+	}
+	i2c_stop();
       }
-    } else {
-      writeEEPROM((uint8_t)byte);
-      counter++;
-      if (counter%256 == 0) {
-	Serial.println("PAGE");
-	counter = 0;
+      continue;
+    }
+    f = &frame[rx];
+    result = rxresult;
+    rx ^= 1; // receive the next frame into the other buffer
+    rxresult = 0;
+    if (result < 0) { // damaged frame
+      reply(NAK, expect);
+      nakked = true;
+      continue;
+    }
+    if (f->seq != expect) {
+      if ((uint8_t)(expect - 1 - f->seq) < 128) { // repeated frame, the ACK got lost
+	if (!pending) reply(ACK, expect - 1);
+      } else if (!nakked) { // a frame got lost, request it only once
+	reply(NAK, expect);
+	nakked = true;
       }
+      continue;
+    }
+    nakked = false;
+    expect++;
+    switch (f->type) {
+    case 'D':
+      if (addr + f->len > MAXADDR + 1) fail(ERR_FULL);
+      if (addr%PAGESIZE + f->len > PAGESIZE) fail(ERR_FRAME);
+      commit();
+      if (!writePage(f->data, f->len)) fail(ERR_I2C);
+      pending = true;
+      pendseq = f->seq;
+      break;
+    case 'E':
+      commit();
+      if (files == 63) fail(ERR_FILES);
+      startaddrs[++files] = addr;
+      reply(ACK, f->seq);
+      break;
+    case 'Z':
+      commit();
+      writeTable();
+      reply(ACK, f->seq);
+      ready = true;
+      break;
+    default:
+      fail(ERR_TYPE);
     }
   }
   pinMode(13,OUTPUT);
   digitalWrite(13,HIGH);
   delay(1000);
-  digitalWrite(13,LOW);  
-  finishEEPage();
-  addr = 0; // write start addr table
-  for (chunk = 0; chunk < 64; chunk++) {
-    writeEEPROM((uint8_t)(startaddrs[chunk]>>24)&0xFF);
-    writeEEPROM((uint8_t)(startaddrs[chunk]>>16)&0xFF);
-    writeEEPROM((uint8_t)(startaddrs[chunk]>>8)&0xFF);
-    writeEEPROM((uint8_t)(startaddrs[chunk])&0xFF);
-  }
+  digitalWrite(13,LOW);
   while (1) { };
 }
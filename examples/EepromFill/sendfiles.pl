@@ -1,26 +1,80 @@
 #!/opt/local/bin/perl
-# Set up the serial port
+# Sends files to EepromFill.ino in binary frames (see there for the protocol)
+# usage: sendfiles.pl [-p port] [-b baud] file ...
 use Device::SerialPort;
-my $port = Device::SerialPort->new("/dev/tty.usbserial-A900ccgj");
+use Getopt::Std;
+use Time::HiRes qw(time);
 
-sub readFile { 
+use constant { STX => 0x02, ACK => 0x06, NAK => 0x15, CAN => 0x18 };
+use constant PAGESIZE => 128;
+use constant WINDOW => 2;   # frames sent ahead of the last ACK
+use constant TIMEOUT => 1;  # sec without a reply before the frames are resent
+
+my %opts = (p => "/dev/tty.usbserial-A900ccgj", b => 115200);
+getopts("p:b:", \%opts);
+my $port = Device::SerialPort->new($opts{p}) or die "Cannot open $opts{p}\n";
+
+sub readFile {
   my($name) = @_;
   my($buffer);
-  my(@outbuf) = ();
   open(INFILE,"<",$name) or die "Cannot open $name\n";
   binmode(INFILE);
-  while(read(INFILE,$buffer,256000) != 0) {
-    push(@outbuf,split(//,$buffer));
-  }
+  local $/;
+  $buffer = <INFILE>;
   close(INFILE);
-  return @outbuf;
+  return defined($buffer) ? $buffer : "";
+}
+
+# CRC-16 (XMODEM), the same as _crc_xmodem_update in avr-libc
+sub crc16 {
+  my $crc = 0;
+  foreach my $c (unpack("C*", $_[0])) {
+    $crc ^= $c << 8;
+    for (1..8) {
+      $crc = ($crc & 0x8000) ? (($crc << 1) ^ 0x1021) : ($crc << 1);
+    }
+    $crc &= 0xFFFF;
+  }
+  return $crc;
+}
+
+my @frames = ();
+sub frame {
+  my($type, $data) = @_;
+  my $body = pack("CaC", scalar(@frames) & 0xFF, $type, length($data)) . $data;
+  push(@frames, pack("C", STX) . $body . pack("n", crc16($body)));
 }
 
 $| = 1;
-$port->baudrate(19200); 
-$port->databits(8); 
+$port->baudrate($opts{b});
+$port->databits(8);
 $port->parity("none");
 $port->stopbits(1);
+$port->handshake("none");
+$port->read_const_time(10);
+$port->read_char_time(0);
+
+# split the files into frames that do not cross EEPROM page boundaries,
+# the first file starts after the table of start addresses
+my $addr = 256;
+my $total = 0;
+if (@ARGV > 63) { die "At most 63 files\n" };
+foreach my $name (@ARGV) {
+  my $buf = readFile($name);
+  my $pos = 0;
+  while ($pos < length($buf)) {
+    my $len = PAGESIZE - $addr % PAGESIZE;
+    $len = length($buf) - $pos if ($len > length($buf) - $pos);
+    frame("D", substr($buf, $pos, $len));
+    $pos += $len;
+    $addr += $len;
+  }
+  frame("E", "");
+  $total += length($buf);
+  printf("%s: %d bytes\n", $name, length($buf));
+}
+frame("Z", "");
+if ($addr > 0x20000) { die "Files do not fit into EEPROM\n" };
 
 # wait for 3 X's
 $port->are_match("XXX");
@@ -29,41 +83,45 @@ while (1) {
   last if ($c ne "");
 }
 
-while (@ARGV) {
-  my $nextfile = shift(@ARGV);
-  my @buf = readFile($nextfile);
-  my $len = @buf;
-  print "Sending $nextfile, $len bytes ...\n";
-  my $counter = 0;
-  while (@buf) {
-    my $byte = ord(shift(@buf));
-    my $hexstr = sprintf("%02X\n",$byte);
-    $port->write("$hexstr");
-    $counter++;
-    if ($counter%256 == 0) {
-      $port->are_match("PAGE");
-      while (1) {
-	my $p = $port->lookfor();
-	last if ($p ne "");
+# send with a window of WINDOW unacknowledged frames; an ACK acknowledges
+# all frames up to its sequence number, a NAK requests to resend from it
+my $base = 0;  # oldest frame not acknowledged
+my $next = 0;  # next frame to send
+my $input = "";
+my $start = time();
+my $deadline = $start + TIMEOUT;
+while ($base < @frames) {
+  while ($next < @frames && $next < $base + WINDOW) {
+    $port->write($frames[$next++]);
+    $deadline = time() + TIMEOUT;
+  }
+  my($count, $got) = $port->read(64);
+  $input .= $got if ($count);
+  while (length($input) >= 3) {
+    my($code, $seq, $check) = unpack("CCC", $input);
+    if (($code != ACK && $code != NAK && $code != CAN) || $seq != (~$check & 0xFF)) {
+      $input = substr($input, 1); # rest of the "XXX" line or a damaged reply
+      next;
+    }
+    $input = substr($input, 3);
+    die "Device aborted the transfer, error $seq\n" if ($code == CAN);
+    # map the 8-bit sequence number to the frame sent last with it
+    my $i = $next;
+    $i-- while ($i > $base && ($i & 0xFF) != $seq);
+    next if (($i & 0xFF) != $seq);
+    if ($code == ACK) {
+      if ($i < $next) {
+	print "." if (int($i/8) != int($base/8));
+	$base = $i + 1;
       }
-      print ".";
+    } else {
+      $next = $i;
     }
-    # print "$hexstr";
+    $deadline = time() + TIMEOUT;
   }
-  $port->write("XX\n");
-  print "... $nextfile sent\n";
-  my $timo = time()+3;
-  $port->are_match("ZZZ");
-  while (time() < $timo) {
-    my $c = $port->lookfor();
-    next if $c eq "";
-    print "ACK received\n";
-    last;
+  if (time() > $deadline) { # nothing heard, resend all frames not acknowledged
+    $next = $base;
   }
-  if (time() >= $timo) { die("no ACK for $nextfile") };
 }
-$port->write(" ZZ\n");
-print "wait to write table\n";
-sleep 3;
-print "DONE\n";
-
+my $secs = time() - $start;
+printf("\n%d bytes sent in %.1f sec (%.0f bytes/sec)\nDONE\n", $total, $secs, $total/($secs || 1));
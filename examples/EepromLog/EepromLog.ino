@@ -0,0 +1,101 @@
+// -*- c++ -*-
+// Logs the analog value of A0 once per second to a 24AA1025 EEPROM using
+// SoftI2CLog.h. After a reset, the log is continued where it ended. Sending
+// 'f' over the serial line formats the log, 'd' dumps it, and a number
+// lists the records of the last so many seconds.
+
+#ifdef __AVR_ATmega328P__
+/* Corresponds to A4/A5 - the hardware I2C pins on Arduinos */
+#define SDA_PORT PORTC
+#define SDA_PIN 4
+#define SCL_PORT PORTC
+#define SCL_PIN 5
+#define I2C_FASTMODE 1
+#else
+#define SDA_PORT PORTB
+#define SDA_PIN 0
+#define SCL_PORT PORTB
+#define SCL_PIN 2
+#define I2C_FASTMODE 1
+#endif
+#define I2C_TIMEOUT 10
+
+#include <SoftI2CMaster.h>
+#include <SoftI2CLog.h>
+
+#define EEPROMADDR 0xA6 // set by jumper (A0 and A1 = High)
+
+struct sample_t {
+  uint16_t value;
+};
+
+I2CLog datalog(EEPROMADDR, sizeof(sample_t));
+uint32_t seconds;
+
+void list(uint32_t from)
+{
+  uint32_t ts;
+  sample_t sample;
+  for (uint32_t seq = from; seq != datalog.next(); seq++) {
+    if (!datalog.read(seq, ts, (uint8_t *)&sample)) {
+      Serial.println(F("Read error"));
+      return;
+    }
+    Serial.print(seq);
+    Serial.print(F(": t="));
+    Serial.print(ts);
+    Serial.print(F(" A0="));
+    Serial.println(sample.value);
+  }
+}
+
+void setup(void)
+{
+  Serial.begin(115200);
+  if (!i2c_init()) Serial.println(F("I2C bus is locked up or there are no pullups!"));
+  if (!datalog.begin()) {
+    Serial.println(F("No log found, formatting EEPROM"));
+    if (!datalog.format()) Serial.println(F("EEPROM not responding"));
+  }
+  seconds = 0;
+  if (datalog.next() != datalog.first()) { // continue with the timestamps of the last run
+    uint32_t ts;
+    sample_t sample;
+    if (datalog.read(datalog.next() - 1, ts, (uint8_t *)&sample)) seconds = ts + 1;
+  }
+  Serial.print(F("Records "));
+  Serial.print(datalog.first());
+  Serial.print(F(" ... "));
+  Serial.println(datalog.next());
+}
+
+void loop(void)
+{
+  static unsigned long last = 0;
+  uint32_t seq;
+  long back;
+
+  if (millis() - last >= 1000) {
+    last += 1000;
+    sample_t sample = { (uint16_t)analogRead(A0) };
+    if (!datalog.append(seconds++, (uint8_t *)&sample)) Serial.println(F("Write error"));
+  }
+  if (Serial.available()) {
+    switch (Serial.peek()) {
+    case 'f':
+      Serial.read();
+      datalog.format();
+      seconds = 0;
+      Serial.println(F("Log formatted"));
+      break;
+    case 'd':
+      Serial.read();
+      list(datalog.first());
+      break;
+    default:
+      back = Serial.parseInt();
+      if (back > 0 && datalog.find(seconds > (uint32_t)back ? seconds - back : 0, seq)) list(seq);
+      break;
+    }
+  }
+}
@@ -47,6 +47,8 @@ void setup(void) {
   Serial.println(F("Intializing ..."));
   Serial.print("I2C delay counter: ");
   Serial.println(I2C_DELAY_COUNTER);
+  Serial.print("SCL frequency (Hz): ");
+  Serial.println(I2C_SCL_FREQ);
   if (!i2c_init()) 
     Serial.println(F("Initialization error. SDA or SCL are low"));
   else
@@ -25,9 +25,19 @@
  * V 1.3 (10-Nov-21)
  * - removed some unused variables 
  * - fixed a if-condition from (token = NUM_TOK) to (token == NUM_TOK) line 677
+ * V 1.4 (18-Oct-26)
+ * - S command uses i2c_scan, i.e., address-only probes with a short stretch timeout
+ * V 1.5 (18-Oct-26)
+ * - lines and macros are compiled into SoftI2CScript bytecode and executed by
+ *   i2c_run_script; macros are stored compiled and are no longer reparsed
+ * - a macro now takes 161 bytes of EEPROM, i.e., 5 macros need 809 bytes;
+ *   with a 512 byte EEPROM, only 3 macros are available
+ * - fixed swapped msec/usec in the trace output
+ * V 1.6 (18-Oct-26)
+ * - B command: benchmark of an I2C interaction, timed with timer 1
  */
 
-#define VERSION "1.3"
+#define VERSION "1.6"
 
 // Something you have to edit!
 #define USEEEPROM 1
@@ -36,6 +46,7 @@
 
 #include <ctype.h>
 #include <stdio.h>
+#include <stddef.h>
 #include <string.h>
 #include <EEPROM.h>
 
@@ -46,6 +57,7 @@
                    "P       - show status of pullups      P<dig>  - enable/disable(1/0) pullups\r\n" \
                    "F       - show current I2C frequency  F<num>  - set I2C frequency in kHz\r\n" \
                    "<dig>=  - define macro                [ ...   - I2C interaction\r\n" \
+                   "B<num> [ ... - execute I2C interaction <num> times and report timing\r\n" \
                    "I2C interaction syntax:\r\n" \
                    "[       - (repeated) start condition  {       - start, polling for ACK\r\n" \
                    "]       - stop condition              r       - read byte\r\n" \
@@ -83,18 +95,31 @@
 #endif
 
 #include <SoftI2CMaster.h>
+#include <SoftI2CScript.h>
 
 // constants for this program
 #define LINELEN 80
-#define MAXCMDS 300
-#define MACROS 5 // note: each macro needs LINELEN space
+#define MAXCODE 200 // bytecode of one line
+#define MAXRES 200 // results of one line (ACKs and bytes read)
+#define MACCODE 80 // bytecode of one macro
 
-// magic code for EEPROM
-#define MAGICKEY 0xA15A372FUL
+// magic code for EEPROM, changed when the macro format changes
+#define MAGICKEY 0xA15A3730UL
 
 // start of saving area for macros
 #define EEMACSTART 4
 
+// number of macros; each one needs LINELEN+1+MACCODE bytes of EEPROM,
+// so there are fewer of them on MCUs with a small EEPROM
+#if USEEEPROM && EEMACSTART + 5*(LINELEN+1+MACCODE) > E2END+1
+#define MACROS ((E2END+1-EEMACSTART)/(LINELEN+1+MACCODE))
+#else
+#define MACROS 5
+#endif
+#if MACROS < 1 || (USEEEPROM && EEMACSTART + MACROS*(LINELEN+1+MACCODE) > E2END+1)
+#error Macros do not fit into the EEPROM
+#endif
+
 // error codes
 #define EXECOVF_ERR -1
 #define REPZERO_ERR -2
@@ -105,22 +130,27 @@
 #define DBLREP_ERR -7
 #define STRTREP_ERR -8
 #define NOADDR_ERR -9
-#define UNKNWN_ERR -10
-
-// exec type (cmds & results)
-typedef enum { START, REPSTART, WSTART, WREPSTART,
-	       WRITE, WRITE_ACK, WRITE_NAK,
-	       READ_ACK, READ_NAK, PAUSE, LPAUSE, STOP, EOC, LOOP } exec_t;
+#define NOREP_ERR -10
+#define UNKNWN_ERR -11
 
 // token types
 typedef enum { EOL_TOK, START_TOK, WSTART_TOK, STOP_TOK,  NUM_TOK, READ_TOK,
 	       WAIT_TOK, LWAIT_TOK, REPEAT_TOK, MAC_TOK, UNDEF_TOK } token_t;
 
+// a macro: its source line and its bytecode
+typedef struct {
+  char text[LINELEN+1];
+  byte code[MACCODE];
+} macro_t;
+#define MACADDR(i) (EEMACSTART + (i)*sizeof(macro_t))
+
 // global variables
 char line[LINELEN*2+1] = { '\0' };
-exec_t cmds[MAXCMDS] = { EOC };
-byte vals[MAXCMDS];
-char macroline[MACROS][LINELEN+1];
+byte code[MAXCODE] = { I2C_OP_END };
+byte results[MAXRES];
+#if !USEEEPROM
+macro_t macros[MACROS];
+#endif
 char illegal_char;
 long illegal_num;
 int i2cfreq = (I2C_FASTMODE ? 400 : (I2C_SLOWMODE ? 25 : 100));
@@ -134,11 +164,7 @@ void setup()
   if (!i2c_init()) {
     Serial.println(F("I2C bus is locked up or there are no pullups!"));
   }
-  for (byte i=0; i < MACROS; i++) macroline[i][0] = '\0';
-#if USEEEPROM
-  getMacrosEEPROM();
-  for (byte i=0; i < MACROS; i++) macroline[i][LINELEN] = '\0';
-#endif
+  initMacros();
 }
 
 void loop()
@@ -157,7 +183,7 @@ void loop()
     scan();
     return;
   case 'T':
-    report(line, cmds, vals);
+    report(line, code, results);
     return;
   case 'P':
     pullups(line[1]);
@@ -165,50 +191,61 @@ void loop()
   case 'F':
     frequency(line);
     return;
+  case 'B':
+    benchmark(line);
+    return;
   }
-  lineres = parseLine(line, cmds, vals, errpos);
+  lineres = parseLine(line, code, errpos);
   if (lineres == 0) {
-    execute(cmds, vals);
-    report("", cmds, vals);
+    execute(code, results);
+    report("", code, results);
   } else if (lineres > 0) {
-    if (lineres-1 < MACROS) storeMacro(lineres-1, line);
+    if (lineres-1 < MACROS) storeMacro(lineres-1, line, code);
     else {
       Serial.println(F("Macro index in definition too large:"));
       Serial.println(lineres-1);
     }
+    code[0] = I2C_OP_END;
   } else {
-    for (int i=0; i < errpos+3; i++) Serial.print(" ");
-    Serial.println("^");
-    switch(lineres) {
-    case EXECOVF_ERR: Serial.print(F("Too many commands"));
-      break;
-    case REPZERO_ERR: Serial.print(F("Repeat counter of 0 is not allowed"));
-      break;
-    case ILLCH_ERR: Serial.print(F("Unrecognized character: '"));
-      Serial.print(illegal_char);
-      Serial.print(F("'"));
-      break;
-    case NUMTL_ERR: Serial.print(F("Number too large: "));
-      Serial.print(illegal_num);
-      break;
-    case ILLMAC_ERR: Serial.print(F("Ill-formed macro call"));
-      break;
-    case WRGMACNUM_ERR: Serial.print(F("Macro number too large"));
-      break;
-    case DBLREP_ERR: Serial.print(F("Double repetition is not allwed"));
-      break;
-    case STRTREP_ERR: Serial.print(F("Start repetition is not allowed"));
-      break;
-    case NOADDR_ERR: Serial.print(F("No address after start condition"));
-      break;
-    default: Serial.print(F("Unrecogized parsing error"));
-      break;
-    }
-    Serial.println();
-    cmds[0] = EOC;
+    parseError(lineres, errpos);
   }
 }
 
+void parseError(int lineres, int errpos)
+{
+  for (int i=0; i < errpos+3; i++) Serial.print(" ");
+  Serial.println("^");
+  switch(lineres) {
+  case EXECOVF_ERR: Serial.print(F("Too many commands"));
+    break;
+  case REPZERO_ERR: Serial.print(F("Repeat counter of 0 is not allowed"));
+    break;
+  case ILLCH_ERR: Serial.print(F("Unrecognized character: '"));
+    Serial.print(illegal_char);
+    Serial.print(F("'"));
+    break;
+  case NUMTL_ERR: Serial.print(F("Number too large: "));
+    Serial.print(illegal_num);
+    break;
+  case ILLMAC_ERR: Serial.print(F("Ill-formed macro call"));
+    break;
+  case WRGMACNUM_ERR: Serial.print(F("Macro number too large"));
+    break;
+  case DBLREP_ERR: Serial.print(F("Double repetition is not allwed"));
+    break;
+  case STRTREP_ERR: Serial.print(F("Start repetition is not allowed"));
+    break;
+  case NOADDR_ERR: Serial.print(F("No address after start condition"));
+    break;
+  case NOREP_ERR: Serial.print(F("Nothing to repeat"));
+    break;
+  default: Serial.print(F("Unrecogized parsing error"));
+    break;
+  }
+  Serial.println();
+  code[0] = I2C_OP_END;
+}
+
 /* ---------------------------- Read line & editing ------------------------*/
 
 
@@ -347,138 +384,180 @@ void insertChar(char *line, int &cursor, int &fill, char newch)
 void insertMacro(char *line, int &cursor, int &fill, int macid)
 {
   int i=0;
+  char c;
   moveCursor(line, cursor, fill, cursor-1);
   deleteChar(line, cursor, fill);
-  while (macroline[macid][i] != '\0' && i < LINELEN) 
-    insertChar(line, cursor, fill, macroline[macid][i++]);
+  while (i < LINELEN && (c = getMacroChar(macid, i++)) != '\0')
+    insertChar(line, cursor, fill, c);
 }
 
-/* ---------------------------- Parsing input line ------------------------*/
+/* ---------------------------- Compiling input line ------------------------*/
+
 
+// length of the instruction with opcode op and argument arg
+int instrLen(byte op, byte arg)
+{
+  if (op == I2C_OP_END) return 1;
+  if (op == I2C_OP_WRITE) return 2 + arg;
+  if (op == I2C_OP_FILL) return 3;
+  return 2;
+}
 
-int parseLine(char *buf, exec_t *cmds, byte *vals, int &lineix)
+int parseLine(char *buf, byte *code, int &lineix)
 {
-  bool busreleased = true;
-  int execix = 0;
-  int result;
+  int codeix = 0;
+  int macindex = 0;
+  int result, resbytes;
+  bool taken;
 
   lineix = 0;
-  result = parseLineHelper(buf, cmds, vals, lineix, execix, busreleased, false);
-
-  if (result >= 0) {
-    execix = 0;
-    while (cmds[execix] != EOC) {
-      if (cmds[execix] == READ_ACK) 
-	if (stopFollows(cmds, execix+1))
-	  cmds[execix] = READ_NAK;
-      execix++;
-    }
+  if (buf[0] >= '0' && buf[0] <= '9' && buf[1] == '=') { // macro def
+    macindex = buf[0] - '0' + 1;
+    lineix = 2;
   }
-  
-  return result;
+  // reserve one byte for END, and for lines two bytes for the final STOP
+  result = compile(buf, code, lineix, codeix, (macindex ? MACCODE-1 : MAXCODE-3));
+  if (result < 0) return result;
+  code[codeix] = I2C_OP_END;
+  fixReads(code);
+  scanCode(code, taken, resbytes);
+  if (taken && !macindex) {
+    code[codeix++] = I2C_OP_STOP;
+    code[codeix++] = 1;
+    code[codeix] = I2C_OP_END;
+  }
+  if (resbytes > MAXRES) return EXECOVF_ERR;
+  return macindex;
 }
 
-bool stopFollows(exec_t *cmds, int index)
+// append instruction op/arg plus extra bytes (filled in by the caller)
+bool emit(byte *code, int &codeix, int limit, int &last, byte op, byte arg, int extra)
 {
-  while (cmds[index] == LOOP || cmds[index] == PAUSE) index++;
-  if (cmds[index] == READ_ACK) return false;
+  if (codeix + 2 + extra > limit) return false;
+  last = codeix;
+  code[codeix++] = op;
+  code[codeix++] = arg;
   return true;
 }
-  
 
-int parseLineHelper(char *buf, exec_t *cmds, byte *vals, int &lineix, int &execix, bool &busreleased, bool recursive)
+// increment the count of the last instruction if it has the same opcode
+bool merge(byte *code, int last, byte op)
 {
-  token_t token = UNDEF_TOK, last = UNDEF_TOK, beforelast = UNDEF_TOK;
-  long value = 0; 
-  int macindex = 0;
-  int maclineix,  maccall, repeat;
-  exec_t cmd;
+  if (last < 0 || code[last+1] == 255) return false;
+  if (code[last] == op || (op == I2C_OP_READ && code[last] == I2C_OP_READ_LAST)) {
+    code[last+1]++;
+    return true;
+  }
+  return false;
+}
 
-  if (buf[0] >= '0' && buf[0] <= '9' && buf[1] == '=') { // macro def
-    macindex = buf[0] - '0' + 1;
-    lineix = 2;
+// copy the bytecode of a macro
+bool splice(byte *code, int &codeix, int limit, int &last, byte mac)
+{
+  int j = 0, len;
+  byte op;
+
+  while ((op = getMacroCode(mac, j)) != I2C_OP_END) {
+    len = instrLen(op, getMacroCode(mac, j+1));
+    if (codeix + len > limit) return false;
+    last = codeix;
+    while (len--) code[codeix++] = getMacroCode(mac, j++);
   }
-  
+  return true;
+}
+
+int compile(char *buf, byte *code, int &lineix, int &codeix, int limit)
+{
+  token_t token = UNDEF_TOK, last_token;
+  long value = 0;
+  int last = -1; // index of last instruction
+  byte start = 0; // start instruction waiting for its address
+  byte op;
+  int count;
+
   while (true) {
-    beforelast = last;
-    last = token;
+    last_token = token;
     token = nextToken(buf, lineix, value);
+    if (start && token != NUM_TOK) 
+      return (token == REPEAT_TOK ? STRTREP_ERR : NOADDR_ERR);
     switch(token) {
     case EOL_TOK:
-      if (recursive) return 0;
-      if (!busreleased) {
-	if (execix > MAXCMDS-2) return EXECOVF_ERR; 
-	cmds[execix++] = STOP;
-      } else {
-	if (execix > MAXCMDS-1) return EXECOVF_ERR;
-      }
-      cmds[execix++] = EOC;
-      return macindex;
+      return 0;
     case START_TOK:
-      if (execix > MAXCMDS-3) return EXECOVF_ERR; // reserve one for EOC, one for STOP
-      if (busreleased) cmds[execix++] = START;
-      else cmds[execix++] = REPSTART;
-      busreleased = false;
+      start = I2C_OP_START;
       break;
     case WSTART_TOK:
-      if (execix > MAXCMDS-3) return EXECOVF_ERR; // reserve one for EOC, one for STOP
-      if (busreleased) cmds[execix++] = WSTART;
-      else cmds[execix++] = WREPSTART;
-      busreleased = false;
+      start = I2C_OP_START_WAIT;
       break;
     case STOP_TOK:
-      if (execix > MAXCMDS-2) return EXECOVF_ERR; // reserve one for EOC
-      cmds[execix++] = STOP;
-      busreleased = true;
+      if (!merge(code, last, I2C_OP_STOP) &&
+	  !emit(code, codeix, limit, last, I2C_OP_STOP, 1, 0)) return EXECOVF_ERR;
       break;
     case NUM_TOK:
       if (value < 0 || value > 255) {
 	illegal_num = value;
 	return NUMTL_ERR;
       }
-      if (execix > 0) {
-	if (cmds[execix-1] == LOOP && vals[execix-1] == 0) {
-	  if (value == 0) {
-	    return REPZERO_ERR;
-	  } else {
-	    vals[execix-1] = value;
-	    value = -1;
-	  }
-	}
-      }
-      if (value >= 0) {
-	if (execix > MAXCMDS-3) return EXECOVF_ERR; // reserve one for EOC, one for STOP
-	cmds[execix] = WRITE;
-	vals[execix++] = value;
+      if (start) {
+	if (!emit(code, codeix, limit, last, start, value, 0)) return EXECOVF_ERR;
+	start = 0;
+      } else if (last >= 0 && code[last] == I2C_OP_WRITE && code[last+1] < 255) {
+	if (codeix + 1 > limit) return EXECOVF_ERR;
+	code[last+1]++;
+	code[codeix++] = value;
+      } else {
+	if (!emit(code, codeix, limit, last, I2C_OP_WRITE, 1, 1)) return EXECOVF_ERR;
+	code[codeix++] = value;
       }
       break;
     case READ_TOK:
-      if (execix > MAXCMDS-3) return EXECOVF_ERR; // reserve one for EOC, one for STOP
-      cmds[execix++] = READ_ACK;
+      if (!merge(code, last, I2C_OP_READ) &&
+	  !emit(code, codeix, limit, last, I2C_OP_READ, 1, 0)) return EXECOVF_ERR;
       break;
     case WAIT_TOK:
-      if (execix > MAXCMDS-3) return EXECOVF_ERR; // reserve one for EOC, one for STOP
-      cmds[execix++] = PAUSE;
+      if (!merge(code, last, I2C_OP_DELAY_US) &&
+	  !emit(code, codeix, limit, last, I2C_OP_DELAY_US, 1, 0)) return EXECOVF_ERR;
       break;
     case LWAIT_TOK:
-      if (execix > MAXCMDS-3) return EXECOVF_ERR; // reserve one for EOC, one for STOP
-      cmds[execix++] = LPAUSE;
+      if (!merge(code, last, I2C_OP_DELAY_MS) &&
+	  !emit(code, codeix, limit, last, I2C_OP_DELAY_MS, 1, 0)) return EXECOVF_ERR;
       break;
     case REPEAT_TOK:
-      if (execix > MAXCMDS-3) return EXECOVF_ERR; // reserve one for EOC, one for STOP
-      if (execix > 0) {
-	if (cmds[execix-1] == LOOP || beforelast == REPEAT_TOK) return DBLREP_ERR;
-	if (cmds[execix-1] == START) return STRTREP_ERR;
-	if (cmds[execix-1] == REPSTART) return STRTREP_ERR;
+      if (last_token == REPEAT_TOK) return DBLREP_ERR;
+      if (last < 0) return NOREP_ERR;
+      op = code[last];
+      if (op == I2C_OP_START || op == I2C_OP_START_WAIT) return STRTREP_ERR;
+      if (nextToken(buf, lineix, value) != NUM_TOK || value == 0) return REPZERO_ERR;
+      if (value > 255) {
+	illegal_num = value;
+	return NUMTL_ERR;
+      }
+      if (op == I2C_OP_WRITE) { // the last byte written becomes a FILL
+	if (code[last+1] == 1) {
+	  code[last] = I2C_OP_FILL;
+	  code[last+1] = value;
+	} else {
+	  if (codeix + 2 > limit) return EXECOVF_ERR;
+	  code[last+1]--;
+	  last = codeix - 1;
+	  code[codeix+1] = code[codeix-1];
+	  code[codeix-1] = I2C_OP_FILL;
+	  code[codeix] = value;
+	  codeix += 2;
+	}
+      } else { // the last unit of the count is repeated
+	count = code[last+1] - 1 + value;
+	if (count > 255) {
+	  illegal_num = count;
+	  return NUMTL_ERR;
+	}
+	code[last+1] = count;
       }
-      cmds[execix] = LOOP;
-      vals[execix++] = 0;
       break;
     case MAC_TOK:
-      maclineix = 0;
+      if (value < 0) return value;
       if (value >= MACROS) return WRGMACNUM_ERR;
-      maccall = parseLineHelper(macroline[value], cmds, vals, maclineix, execix, busreleased, true);
-      if (maccall < 0) return maccall;
+      if (!splice(code, codeix, limit, last, value)) return EXECOVF_ERR;
       break;
     case UNDEF_TOK:
       return ILLCH_ERR;
@@ -487,25 +566,60 @@ int parseLineHelper(char *buf, exec_t *cmds, byte *vals, int &lineix, int &execi
       return UNKNWN_ERR;
       break;
     }
-    if (execix >= 2 && cmds[execix-1] == LOOP && vals[execix-1] > 0 &&
-	(cmds[execix-2] == READ_ACK ||  cmds[execix-2] == WRITE)) {
-      // unfold read and write commands!
-      repeat = vals[execix-1];
-      cmd = cmds[execix-2];
-      value = vals[execix-2];
-      execix--;
-      if (execix + repeat - 1 > MAXCMDS-3) return EXECOVF_ERR;
-      for (byte i=0; i<repeat-1; i++) {
-	cmds[execix] = cmd;
-	vals[execix++] = value;
-      }
+  }
+}
+
+// the last read before anything else than a read (or a usec pause) gets a NAK
+void fixReads(byte *code)
+{
+  int i = 0, j;
+  while (code[i] != I2C_OP_END) {
+    if (code[i] == I2C_OP_READ || code[i] == I2C_OP_READ_LAST) {
+      j = i + 2;
+      while (code[j] == I2C_OP_DELAY_US) j += 2;
+      if (code[j] == I2C_OP_READ || code[j] == I2C_OP_READ_LAST) code[i] = I2C_OP_READ;
+      else code[i] = I2C_OP_READ_LAST;
     }
-    if (execix >= 2 && (cmds[execix-2] == START || cmds[execix-2] == REPSTART) &&
-	cmds[execix-1] != WRITE)
-      return NOADDR_ERR;
+    i += instrLen(code[i], code[i+1]);
   }
 }
 
+// is the bus taken at the end, and how many result bytes will be recorded?
+void scanCode(byte *code, bool &taken, int &resbytes)
+{
+  int i = 0;
+  taken = false;
+  resbytes = 0;
+  while (code[i] != I2C_OP_END) {
+    switch (code[i]) {
+    case I2C_OP_START_WAIT:
+      resbytes++;
+      // fall through
+    case I2C_OP_START:
+      resbytes++;
+      taken = true;
+      break;
+    case I2C_OP_STOP:
+      taken = false;
+      break;
+    case I2C_OP_WRITE:
+    case I2C_OP_FILL:
+    case I2C_OP_READ:
+    case I2C_OP_READ_LAST:
+      resbytes += code[i+1];
+      break;
+    }
+    i += instrLen(code[i], code[i+1]);
+  }
+}
+
+int codeLength(byte *code)
+{
+  int i = 0;
+  while (code[i] != I2C_OP_END) i += instrLen(code[i], code[i+1]);
+  return i + 1;
+}
+
 token_t nextToken(char *buf, int &i, long &value)
 {
   char nextch;
@@ -580,102 +694,45 @@ int parseMac(char *buf, int &i)
 /* ---------------------------- Execution & reporting ------------------------*/
 
 
-void execute(exec_t *cmds, byte *vals)
+void execute(byte *code, byte *res)
 {
-  int i = 0;
-  bool ack;
-  while (true) {
-    switch(cmds[i]) {
-    case START:
-      i++;
-      if (cmds[i] == WRITE) {
-	ack = i2c_start(vals[i]);
-	cmds[i++] = (ack ? WRITE_ACK : WRITE_NAK);
-      }
-      break;
-    case REPSTART:
-      i++;
-      if (cmds[i] == WRITE) {
-	ack = i2c_rep_start(vals[i]);
-	cmds[i++] = (ack ? WRITE_ACK : WRITE_NAK);
-      }
-      break;
-    case WSTART:
-      i++;
-      if (cmds[i] == WRITE) {
-	vals[i-1] = 0;
-	ack = false;
-	while (vals[i-1] < 255 && !ack) {
-	  ack = i2c_start(vals[i]);
-	  if (!ack) i2c_stop();
-	  vals[i-1]++;
-	}
-	vals[i-1]--;
-	cmds[i++] = (ack ? WRITE_ACK : WRITE_NAK);
-      }
-      break;
-    case WREPSTART:
-      i++;
-      if (cmds[i] == WRITE) {
-	vals[i-1] = 0;
-	ack = false;
-	while (vals[i-1] < 255 && !ack) {
-	  ack = i2c_rep_start(vals[i]);
-	  if (!ack) i2c_stop();
-	  vals[i-1]++;
-	}
-	vals[i-1]--;
-	cmds[i++] = (ack ? WRITE_ACK : WRITE_NAK);
-      }
-      break;
-    case WRITE:
-      ack = i2c_write(vals[i]);
-      cmds[i++] = (ack ? WRITE_ACK : WRITE_NAK);
-      break;
-    case READ_ACK: 
-      vals[i++] = i2c_read(false);
-      break;
-    case READ_NAK: 
-      vals[i++] = i2c_read(true);
-      break;
-    case PAUSE:
-      i++;
-      if (cmds[i] == LOOP) delayMicroseconds(vals[i++]);
-      else delayMicroseconds(1);
-      break;
-    case LPAUSE:
-      i++;
-      if (cmds[i] == LOOP) delay(vals[i++]);
-      else delay(1);
-      break;
-    case STOP: 
-      i++;
-      if (cmds[i] == LOOP) {
-	for (byte i=0; i < vals[i]; i++) {
-	  i2c_stop();
-	  delayMicroseconds(1);
-	}
-	i++;
-      } else i2c_stop(); 
-      break;
-    case LOOP:
-      break;
-    case EOC:
-      delay(200); // decouple from console output!
-      return;
-    }
+  i2c_run_script(code, I2C_SCRIPT_RAM, res, I2C_SCRIPT_TRACE);
+  delay(200); // decouple from console output!
+}
+
+void printHex(byte val)
+{
+  Serial.print(F("0x"));
+  if (val < 0x10) Serial.print(0);
+  Serial.print(val, HEX);
+}
+
+void printAck(bool ack)
+{
+  Serial.println((ack ? F(" + ACK") : F(" + NAK")));
+}
+
+void printRepetitions(byte count)
+{
+  if (count > 1) {
+    Serial.print(F(": "));
+    Serial.print(count);
+    Serial.print(F(" repetitions"));
   }
+  Serial.println();
 }
 
-void report(char *line, exec_t *cmds, byte *vals)
+void report(char *line, byte *code, byte *res)
 {
  int i = 0;
- bool nostart;
+ int n = 0;
  int startline = 0;
  int stopline = 0;
  long val;
  int ix = 1;
  token_t token;
+ bool taken = false;
+ byte op, arg;
  if (strlen(line) > 1) {
    token = nextToken(line, ix, val);
    if (token == NUM_TOK) {
@@ -683,107 +740,110 @@ void report(char *line, exec_t *cmds, byte *vals)
      stopline = startline + 19;
    }
  }
- while (true) {
-   if (i >= startline && (i <= stopline || stopline == 0)) {
-     switch(cmds[i]) {
-     case START:
-       Serial.print(F("Start: "));
-       break;
-     case REPSTART:
-       Serial.print(F("Rep. start: "));
-       break;
-     case WSTART:
-       Serial.print(F("Start ("));
-       Serial.print(vals[i]);
-       Serial.print(F(" NAKs): "));
-       break;
-     case WREPSTART:
-       Serial.print(F("Rep. start ("));
-       Serial.print(vals[i]);
-       Serial.print(F(" NAKs): "));
-       break;
-     case WRITE_ACK:
-     case WRITE_NAK:
-       nostart = false;
-       if (i == 0 || (cmds[i-1] != START && cmds[i-1] != REPSTART && cmds[i-1] != WSTART && cmds[i-1] != WREPSTART)) {
+ while ((op = code[i]) != I2C_OP_END) {
+   arg = code[i+1];
+   switch(op) {
+   case I2C_OP_START:
+   case I2C_OP_START_WAIT:
+     if (n >= startline && (n <= stopline || stopline == 0)) {
+       Serial.print((taken ? F("Rep. start") : F("Start")));
+       if (op == I2C_OP_START_WAIT) {
+	 Serial.print(F(" ("));
+	 Serial.print(res[0]);
+	 Serial.print(F(" NAKs)"));
+       }
+       Serial.print(F(": "));
+       printHex(arg);
+       Serial.print(F(" ("));
+       printHex(arg>>1);
+       Serial.print((arg%2 == 0 ? "!" : "?"));
+       Serial.print(F(")"));
+       printAck(res[op == I2C_OP_START_WAIT ? 1 : 0]);
+     }
+     n++;
+     res += (op == I2C_OP_START_WAIT ? 2 : 1);
+     taken = true;
+     break;
+   case I2C_OP_WRITE:
+   case I2C_OP_FILL:
+     for (byte k=0; k < arg; k++, n++, res++) {
+       if (n >= startline && (n <= stopline || stopline == 0)) {
 	 Serial.print(F("Write: "));
-	 nostart = true;
+	 printHex(code[i+2+(op == I2C_OP_WRITE ? k : 0)]);
+	 printAck(*res);
        }
-       Serial.print(F("0x"));
-       if (vals[i] < 0x10) Serial.print(0);
-       Serial.print(vals[i], HEX);
-       if (!nostart) {
-	 Serial.print(F(" (0x"));
-	 if ((vals[i]>>1) < 0x10) Serial.print(0);
-	 Serial.print((vals[i]>>1), HEX);
-	 Serial.print(((vals[i])%2 == 0 ? "!" : "?"));
-	 Serial.print(F(")"));
+     }
+     break;
+   case I2C_OP_READ:
+   case I2C_OP_READ_LAST:
+     for (byte k=0; k < arg; k++, n++, res++) {
+       if (n >= startline && (n <= stopline || stopline == 0)) {
+	 Serial.print(F("Read: "));
+	 printHex(*res);
+	 printAck(op == I2C_OP_READ || k < arg-1);
        }
-       Serial.println(((cmds[i] == WRITE_ACK ? " + ACK" : " + NAK")));
-       break;
-     case READ_ACK: 
-     case READ_NAK:
-       Serial.print(F("Read: 0x"));
-       if (vals[i] < 0x10) Serial.print(0);
-       Serial.print(vals[i], HEX);
-       Serial.println(((cmds[i] == READ_ACK ? " + ACK" : " + NAK")));
-       break;
-     case LPAUSE:
-     case PAUSE:
-       if (cmds[i] == PAUSE)
-	 Serial.print(F("msec delay"));
-       else
+     }
+     break;
+   case I2C_OP_DELAY_US:
+   case I2C_OP_DELAY_MS:
+     if (n >= startline && (n <= stopline || stopline == 0)) {
+       if (op == I2C_OP_DELAY_US)
 	 Serial.print(F("\u03BC" "sec delay"));
-       if (cmds[i+1] == LOOP) {
-	 Serial.print(F(": "));
-	 Serial.print(vals[i+1]);
-	 Serial.print(F(" repetitions"));
-       }
-       Serial.println();
-       break;
-     case STOP: 
+       else
+	 Serial.print(F("msec delay"));
+       printRepetitions(arg);
+     }
+     n++;
+     break;
+   case I2C_OP_STOP:
+     if (n >= startline && (n <= stopline || stopline == 0)) {
        Serial.print(F("Stop"));
-       if (cmds[i+1] == LOOP) {
-	 Serial.print(F(": "));
-	 Serial.print(vals[i+1]);
-	 Serial.print(F(" repetitions"));
-       }
-       Serial.println();
-       break;
-     case EOC:
-       return;
-       break;
+       printRepetitions(arg);
      }
+     n++;
+     taken = false;
+     break;
    }
-   if (cmds[i++] == EOC) return;
+   i += instrLen(op, arg);
  }
 }
 
 /* ---------------------------- Shell commands ------------------------*/
 
 
-void storeMacro(int macnum, char *line)
+void storeMacro(int macnum, char *line, byte *code)
 {
-  strncpy(macroline[macnum], &(line[2]), LINELEN+1);
+  char *text = &(line[2]);
+  int textlen = strlen(text) + 1;
+  int codelen = codeLength(code);
 #if USEEEPROM
-  putMacrosEEPROM();
+  for (int j=0; j < textlen; j++)
+    EEPROM.update(MACADDR(macnum) + offsetof(macro_t, text) + j, text[j]);
+  for (int j=0; j < codelen; j++)
+    EEPROM.update(MACADDR(macnum) + offsetof(macro_t, code) + j, code[j]);
+#else
+  memcpy(macros[macnum].text, text, textlen);
+  memcpy(macros[macnum].code, code, codelen);
 #endif
 }
 
+void printMacro(byte i)
+{
+  char c;
+  Serial.print(i);
+  Serial.print(F("="));
+  for (byte j=0; j < LINELEN && (c = getMacroChar(i, j)) != '\0'; j++)
+    Serial.print(c);
+  Serial.println();
+}
 
 void list(char index)
 {
   byte i = index - '0';
   if (i >= 0 && i < MACROS) {
-    Serial.print(i);
-    Serial.print(F("="));
-    Serial.println(macroline[i]);
+    printMacro(i);
   } else {
-    for (i=0; i < MACROS; i++) {
-      Serial.print(i);
-      Serial.print(F("="));
-      Serial.println(macroline[i]);
-    }
+    for (i=0; i < MACROS; i++) printMacro(i);
   }
 }
     
@@ -797,22 +857,23 @@ void help() {
 
 void scan()
 {
+  byte map[16];
   Serial.println(F("Scanning ..."));
+  if (!i2c_scan(map, 0, 0x7F)) {
+    Serial.println(F("I2C bus is locked up!"));
+    return;
+  }
   Serial.println(F(" 8-bit 7-bit addr"));
-  for (int addr = 0; addr < 256; addr = addr+1) {
-    if (i2c_start(addr)) {
-      if (addr%2 == 0) i2c_write(0);
-      else i2c_read(true);
-      i2c_stop();
+  for (int addr = 0; addr < 128; addr++) {
+    if (map[addr>>3] & (1<<(addr&7))) {
       Serial.print(F(" 0x"));
+      if (addr<<1 <= 0xF) Serial.print(0);
+      Serial.print(addr<<1,HEX);
+      Serial.print(F("  0x"));
       if (addr <= 0xF) Serial.print(0);
       Serial.print(addr,HEX);
-      Serial.print(F("  0x"));
-      if (addr>>1 <= 0xF) Serial.print(0);
-      Serial.print((addr>>1),HEX);
-      Serial.println((addr%2 == 0 ? "!" : "?"));
-      delay(200); // 
-    } else i2c_stop();
+      Serial.println(F("!"));
+    }
   }  
 }
 
@@ -828,10 +889,12 @@ void pullups(char arg)
   if (arg == '1') { // enable pullups
     digitalWrite(SDA, 1);
     digitalWrite(SCL, 1);
+    i2cpullups = true;
     Serial.println(F("Pullups enabled"));
   } else if (arg == '0') { // disable pullups
     digitalWrite(SDA, 0);
     digitalWrite(SCL, 0);
+    i2cpullups = false;
     Serial.println(F("Pullups disabled"));
   } else {
     Serial.println(F("Specify 0 or 1 with P command or append nothing"));
@@ -899,20 +962,205 @@ void frequency(char *line)
 #endif
 }
 
-/* ---------------------------- Macros in EEPROM ------------------------*/
+/* ---------------------------- Benchmark ------------------------*/
 
+// Timer 1 runs with prescaler 8 during a benchmark, its overflows are
+// counted in order to get 32-bit timestamps
+#ifdef TIMSK1
+#define TICKS_PER_USEC (F_CPU/8000000.0)
+volatile unsigned int benchovf;
+byte savedtccr1a, savedtccr1b, savedtimsk1;
 
-void getMacrosEEPROM()
+ISR(TIMER1_OVF_vect)
 {
-  unsigned long key;
-  EEPROM.get(0, key);
-  if (key == MAGICKEY) 
-    EEPROM.get(EEMACSTART, macroline);
+  benchovf++;
+}
+
+void startTimer()
+{
+  savedtccr1a = TCCR1A;
+  savedtccr1b = TCCR1B;
+  savedtimsk1 = TIMSK1;
+  TCCR1B = 0;
+  TCCR1A = 0;
+  TCNT1 = 0;
+  benchovf = 0;
+  TIFR1 = _BV(TOV1);
+  TIMSK1 = _BV(TOIE1);
+  TCCR1B = _BV(CS11);
+}
+
+void stopTimer()
+{
+  TCCR1B = 0;
+  TIMSK1 = savedtimsk1;
+  TCCR1A = savedtccr1a;
+  TCCR1B = savedtccr1b;
+}
+
+unsigned long readTimer()
+{
+  byte sreg = SREG;
+  unsigned int ovf, cnt;
+  cli();
+  cnt = TCNT1;
+  ovf = benchovf;
+  if ((TIFR1 & _BV(TOV1)) && cnt < 0x8000) ovf++; // overflow not served yet
+  SREG = sreg;
+  return ((unsigned long)ovf << 16) | cnt;
+}
+#else
+#define TICKS_PER_USEC 1.0
+void startTimer() { }
+void stopTimer() { }
+unsigned long readTimer() { return micros(); }
+#endif
+
+// bytes on the bus for one execution (addresses, written and read bytes)
+int busBytes(byte *code)
+{
+  int i = 0, bytes = 0;
+  while (code[i] != I2C_OP_END) {
+    switch (code[i]) {
+    case I2C_OP_START:
+    case I2C_OP_START_WAIT:
+      bytes++;
+      break;
+    case I2C_OP_WRITE:
+    case I2C_OP_FILL:
+    case I2C_OP_READ:
+    case I2C_OP_READ_LAST:
+      bytes += code[i+1];
+      break;
+    }
+    i += instrLen(code[i], code[i+1]);
+  }
+  return bytes;
+}
+
+// count the NAKs in a trace; the NAKs before the ACK of a polling start
+// are counted as polls
+void countNaks(byte *code, byte *res, unsigned long &naks, unsigned long &polls)
+{
+  int i = 0;
+  byte op;
+  while ((op = code[i]) != I2C_OP_END) {
+    switch (op) {
+    case I2C_OP_START_WAIT:
+      polls += *res++;
+      // fall through
+    case I2C_OP_START:
+      if (!*res++) naks++;
+      break;
+    case I2C_OP_WRITE:
+    case I2C_OP_FILL:
+      for (byte k=0; k < code[i+1]; k++)
+	if (!*res++) naks++;
+      break;
+    case I2C_OP_READ:
+    case I2C_OP_READ_LAST:
+      res += code[i+1];
+      break;
+    }
+    i += instrLen(op, code[i+1]);
+  }
 }
 
-void putMacrosEEPROM()
+// B<num> <I2C interaction>: execute it <num> times and report the timing;
+// a failed execution that took at least I2C_TIMEOUT msec counts as a timeout
+void benchmark(char *line)
 {
-  unsigned long key = MAGICKEY;
+  int ix = 1, errpos, lineres, bytes;
+  long runs;
+  unsigned long start, ticks, mint = 0xFFFFFFFFUL, maxt = 0, naks = 0, polls = 0, timeouts = 0;
+  float total = 0;
+  bool ok;
+
+  if (nextToken(line, ix, runs) != NUM_TOK || runs < 1 || runs > 65535) {
+    Serial.println(F("Specify the number of executions (1-65535) after B"));
+    return;
+  }
+  lineres = parseLine(&line[ix], code, errpos);
+  if (lineres != 0) {
+    parseError(lineres, errpos + ix);
+    return;
+  }
+  bytes = busBytes(code);
+  Serial.flush(); // no serial interrupts while measuring
+  startTimer();
+  for (long n=0; n < runs; n++) {
+    start = readTimer();
+    ok = i2c_run_script(code, I2C_SCRIPT_RAM, results, I2C_SCRIPT_TRACE);
+    ticks = readTimer() - start;
+    if (ticks < mint) mint = ticks;
+    if (ticks > maxt) maxt = ticks;
+    total += ticks;
+    countNaks(code, results, naks, polls);
+    if (!ok && I2C_TIMEOUT && ticks >= I2C_TIMEOUT*1000UL*TICKS_PER_USEC) timeouts++;
+  }
+  stopTimer();
+  total /= TICKS_PER_USEC;
+  Serial.print(runs);
+  Serial.print(F(" executions at "));
+  Serial.print(i2cfreq);
+  Serial.print(F(" kHz, pullups "));
+  Serial.println((i2cpullups ? F("enabled") : F("disabled")));
+  Serial.print(F("Bytes per execution: "));
+  Serial.print(bytes);
+  Serial.print(F(", throughput: "));
+  Serial.print(bytes*runs/(total/1000000.0), 0);
+  Serial.println(F(" bytes/sec"));
+  Serial.print(F("Time per execution (\u03BC" "sec): min "));
+  Serial.print(mint/TICKS_PER_USEC, 1);
+  Serial.print(F(", avg "));
+  Serial.print(total/runs, 1);
+  Serial.print(F(", max "));
+  Serial.println(maxt/TICKS_PER_USEC, 1);
+  Serial.print(F("NAKs: "));
+  Serial.print(naks);
+  Serial.print(F(", ACK polls: "));
+  Serial.print(polls);
+  Serial.print(F(", timeouts: "));
+  Serial.println(timeouts);
+}
+
+/* ---------------------------- Macro storage ------------------------*/
+
+#if USEEEPROM
+char getMacroChar(byte i, byte j)
+{
+  return EEPROM.read(MACADDR(i) + offsetof(macro_t, text) + j);
+}
+
+byte getMacroCode(byte i, int j)
+{
+  return EEPROM.read(MACADDR(i) + offsetof(macro_t, code) + j);
+}
+#else
+char getMacroChar(byte i, byte j)
+{
+  return macros[i].text[j];
+}
+
+byte getMacroCode(byte i, int j)
+{
+  return macros[i].code[j];
+}
+#endif
+
+// macros are kept in EEPROM only; clear them if the EEPROM has not been
+// initialized with the current format
+void initMacros()
+{
+#if USEEEPROM
+  unsigned long key;
+  EEPROM.get(0, key);
+  if (key == MAGICKEY) return;
+  for (byte i=0; i < MACROS; i++) {
+    EEPROM.update(MACADDR(i) + offsetof(macro_t, text), '\0');
+    EEPROM.update(MACADDR(i) + offsetof(macro_t, code), I2C_OP_END);
+  }
+  key = MAGICKEY;
   EEPROM.put(0, key);
-  EEPROM.put(EEMACSTART, macroline);
+#endif
 }
@@ -0,0 +1,134 @@
+// -*- c++ -*-
+// Polls an accelerometer (BMA020) every 10 msec and an IR thermometer
+// (MLX90614) every 500 msec, and logs the accelerometer values to a
+// 24AA1025 EEPROM in the remaining bus time. The scheduler from
+// SoftI2CScheduler.h orders the transactions so that the EEPROM page
+// writes do not delay the accelerometer reads, and the write cycles of the
+// EEPROM are used for the other devices instead of polling the EEPROM.
+
+#ifdef __AVR_ATmega328P__
+/* Corresponds to A4/A5 - the hardware I2C pins on Arduinos */
+#define SDA_PORT PORTC
+#define SDA_PIN 4
+#define SCL_PORT PORTC
+#define SCL_PIN 5
+#define I2C_FASTMODE 1
+#else
+#define SDA_PORT PORTB
+#define SDA_PIN 0
+#define SCL_PORT PORTB
+#define SCL_PIN 2
+#define I2C_FASTMODE 1
+#endif
+#define I2C_TIMEOUT 10
+
+#include <SoftI2CMaster.h>
+#include <SoftI2CScheduler.h>
+
+#define BMAADDR 0x70
+#define MLXADDR (0x5A<<1)
+#define EEPROMADDR 0xA6
+#define PAGESIZE 128
+
+// one page is filled while the other one is written; a page holds 21 samples,
+// and its last 2 bytes are set to 0xFF
+uint8_t page[2][PAGESIZE];
+uint8_t fill = 0, filled = 0;
+bool full = false;
+uint32_t eepaddr = 0;
+int xval, yval, zval;
+float celsius;
+
+// hand the filled page over to writeLog and continue with the other one
+void closePage(void)
+{
+  memset(&page[filled][fill], 0xFF, PAGESIZE - fill);
+  fill = 0;
+  filled ^= 1;
+  full = true;
+}
+
+uint16_t readAccel(void)
+{
+  uint8_t buf[6];
+  if (!i2c_start(BMAADDR | I2C_WRITE) || !i2c_write(0x02) || !i2c_rep_start(BMAADDR | I2C_READ)) {
+    i2c_stop();
+    return 0;
+  }
+  for (uint8_t i = 0; i < 6; i++) buf[i] = i2c_read(i == 5);
+  i2c_stop();
+  xval = (int)((buf[1]<<8)|buf[0])/64;
+  yval = (int)((buf[3]<<8)|buf[2])/64;
+  zval = (int)((buf[5]<<8)|buf[4])/64;
+  if (fill > PAGESIZE - 6 && !full) closePage(); // the other page has been written meanwhile
+  if (fill <= PAGESIZE - 6) { // otherwise, both pages are waiting and the sample is lost
+    memcpy(&page[filled][fill], buf, 6);
+    fill += 6;
+  }
+  if (fill > PAGESIZE - 6 && !full) closePage();
+  return 0;
+}
+
+uint16_t readTemp(void)
+{
+  uint8_t low, high;
+  if (!i2c_start(MLXADDR | I2C_WRITE) || !i2c_write(0x07) || !i2c_rep_start(MLXADDR | I2C_READ)) {
+    i2c_stop();
+    return 0;
+  }
+  low = i2c_read(false);
+  high = i2c_read(false);
+  i2c_read(true); // PEC
+  i2c_stop();
+  celsius = (((high & 0x7F) << 8) + low) * 0.02 - 0.01 - 273.15;
+  return 0;
+}
+
+uint16_t writeLog(void)
+{
+  if (!full) return 0;
+  uint8_t addr = EEPROMADDR | (eepaddr & 0x10000 ? 8 : 0);
+  if (i2c_start(addr | I2C_WRITE) && i2c_write((eepaddr>>8)&0xFF) && i2c_write(eepaddr&0xFF))
+    for (uint8_t i = 0; i < PAGESIZE; i++)
+      if (!i2c_write(page[filled^1][i])) break;
+  i2c_stop();
+  eepaddr = (eepaddr + PAGESIZE) & 0x1FFFF;
+  full = false;
+  return 5; // write cycle time of the EEPROM
+}
+
+// period (msec), deadline (msec), estimated bus time (usec)
+I2CTask tasks[] = {
+  { readAccel, 10, 2, 300 },
+  { readTemp, 500, 100, 250 },
+  { writeLog, 20, 0, 4000 },
+};
+I2CScheduler scheduler(tasks, sizeof(tasks)/sizeof(tasks[0]));
+
+void setup(void)
+{
+  Serial.begin(115200);
+  if (!i2c_init()) Serial.println(F("I2C bus is locked up or there are no pullups!"));
+  scheduler.begin();
+}
+
+void loop(void)
+{
+  static unsigned long last = 0;
+  scheduler.run();
+  if (millis() - last >= 1000) {
+    last = millis();
+    Serial.print(F("X="));
+    Serial.print(xval);
+    Serial.print(F(" Y="));
+    Serial.print(yval);
+    Serial.print(F(" Z="));
+    Serial.print(zval);
+    Serial.print(F(" T="));
+    Serial.print(celsius);
+    Serial.print(F(" bus utilization="));
+    Serial.print(scheduler.utilization());
+    Serial.print(F("% missed deadlines="));
+    Serial.println(scheduler.missed());
+  }
+}
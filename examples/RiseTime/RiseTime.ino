@@ -0,0 +1,81 @@
+// -*- c++ -*-
+// Measures the rise times of SDA and SCL, which depend on the pull-up
+// resistors and the bus capacitance, and prints the highest bus frequency
+// they allow. Uncomment I2C_PULLUP in order to check whether the internal
+// pull-ups of the MCU are sufficient for the bus.
+
+#ifdef __AVR_ATmega328P__
+/* Corresponds to A4/A5 - the hardware I2C pins on Arduinos */
+#define SDA_PORT PORTC
+#define SDA_PIN 4
+#define SCL_PORT PORTC
+#define SCL_PIN 5
+#else
+#define SDA_PORT PORTB
+#define SDA_PIN 0
+#define SCL_PORT PORTB
+#define SCL_PIN 2
+#endif
+// #define I2C_PULLUP 1
+
+#include <SoftI2CMaster.h>
+
+#define RUNS 16
+
+// longest rise time of several measurements
+uint16_t measure(bool scl)
+{
+  uint16_t rise, longest = 0;
+  for (uint8_t i = 0; i < RUNS; i++) {
+    rise = i2c_rise_time(scl);
+    if (rise > longest) longest = rise;
+  }
+  return longest;
+}
+
+void report(const __FlashStringHelper *name, uint16_t rise)
+{
+  Serial.print(name);
+  if (rise == 0xFFFF) {
+    Serial.println(F(" does not go high: no pull-up or stuck low"));
+    return;
+  }
+  Serial.print(F(" rise time: "));
+  Serial.print(rise);
+  Serial.print(F(" ns, max. "));
+  Serial.print(i2c_max_scl_khz(rise));
+  Serial.println(F(" kHz"));
+}
+
+void setup(void)
+{
+  uint16_t sda, scl;
+
+  Serial.begin(19200);
+  i2c_init();
+  sda = measure(false);
+  scl = measure(true);
+  report(F("SDA"), sda);
+  report(F("SCL"), scl);
+  if (sda != 0xFFFF && scl != 0xFFFF) {
+    Serial.print(F("Recommended: "));
+    switch (i2c_max_scl_khz(sda > scl ? sda : scl)) {
+    case 400:
+      Serial.println(F("I2C_FASTMODE"));
+      break;
+    case 100:
+      Serial.println(F("standard mode"));
+      break;
+    case 25:
+      Serial.println(F("I2C_SLOWMODE"));
+      break;
+    default:
+      Serial.println(F("stronger pull-ups"));
+    }
+  }
+  Serial.print(F("Resolution: "));
+  Serial.print(6000UL/(I2C_CPUFREQ/1000000UL));
+  Serial.println(F(" ns"));
+}
+
+void loop(void) { }
@@ -0,0 +1,115 @@
+// -*- c++ -*-
+// Negotiates the bus speed of a 24AA1025 EEPROM (up to 400 kHz) and of an
+// IR thermometer MLX90614 (SMBus, up to 100 kHz) on the same bus. The
+// EEPROM is checked by reading back a block that was read in slow mode
+// before, the thermometer by the PEC (CRC-8) of its replies. Afterwards,
+// every transaction runs at the speed of the addressed device.
+
+#ifdef __AVR_ATmega328P__
+/* Corresponds to A4/A5 - the hardware I2C pins on Arduinos */
+#define SDA_PORT PORTC
+#define SDA_PIN 4
+#define SCL_PORT PORTC
+#define SCL_PIN 5
+#else
+#define SDA_PORT PORTB
+#define SDA_PIN 0
+#define SCL_PORT PORTB
+#define SCL_PIN 2
+#endif
+#define I2C_TIMEOUT 10
+#define I2C_SPEEDSWITCH 1
+
+#include <SoftI2CMaster.h>
+#include <util/crc16.h>
+
+#define EEPROMADDR 0xA6
+#define MLXADDR (0x5A<<1)
+#define BLOCKSIZE 32
+
+uint8_t reference[BLOCKSIZE];
+const char *speedname[] = { "default", "25 kHz", "100 kHz", "400 kHz" };
+
+// read <len> bytes from EEPROM address 0
+bool readEeprom(uint8_t *buf, uint8_t len)
+{
+  bool ok = i2c_start(EEPROMADDR | I2C_WRITE) && i2c_write(0) && i2c_write(0) &&
+    i2c_rep_start(EEPROMADDR | I2C_READ);
+  if (ok)
+    for (uint8_t i = 0; i < len; i++) buf[i] = i2c_read(i == len - 1);
+  i2c_stop();
+  return ok;
+}
+
+bool verifyEeprom(uint8_t addr)
+{
+  uint8_t buf[BLOCKSIZE];
+  (void) addr; // the EEPROM address is fixed
+  return readEeprom(buf, BLOCKSIZE) && memcmp(buf, reference, BLOCKSIZE) == 0;
+}
+
+// read a RAM register of the MLX90614 and check the PEC
+bool readMlx(uint8_t reg, uint16_t &val)
+{
+  uint8_t lo, hi, pec, crc;
+  bool ok = i2c_start(MLXADDR | I2C_WRITE) && i2c_write(reg) &&
+    i2c_rep_start(MLXADDR | I2C_READ);
+  if (ok) {
+    lo = i2c_read(false);
+    hi = i2c_read(false);
+    pec = i2c_read(true);
+  }
+  i2c_stop();
+  if (!ok) return false;
+  crc = _crc8_ccitt_update(0, MLXADDR | I2C_WRITE);
+  crc = _crc8_ccitt_update(crc, reg);
+  crc = _crc8_ccitt_update(crc, MLXADDR | I2C_READ);
+  crc = _crc8_ccitt_update(crc, lo);
+  crc = _crc8_ccitt_update(crc, hi);
+  val = (hi << 8) | lo;
+  return crc == pec;
+}
+
+bool verifyMlx(uint8_t addr)
+{
+  uint16_t val;
+  (void) addr; // the MLX90614 address is fixed
+  return readMlx(0x07, val);
+}
+
+void setup(void)
+{
+  uint8_t speed;
+
+  Serial.begin(19200);
+  if (!i2c_init()) Serial.println(F("I2C init failed"));
+  i2c_set_speed(EEPROMADDR, I2C_SPEED_SLOW);
+  if (!readEeprom(reference, BLOCKSIZE)) Serial.println(F("EEPROM does not respond"));
+  speed = i2c_negotiate_speed(EEPROMADDR, verifyEeprom);
+  Serial.print(F("EEPROM: "));
+  Serial.println(speedname[speed]);
+  speed = i2c_negotiate_speed(MLXADDR, verifyMlx);
+  Serial.print(F("MLX90614: "));
+  Serial.println(speedname[speed]);
+}
+
+void loop(void)
+{
+  uint16_t val;
+  uint8_t buf[BLOCKSIZE];
+  uint32_t start;
+
+  start = micros();
+  readEeprom(buf, BLOCKSIZE);
+  Serial.print(F("EEPROM block read in "));
+  Serial.print(micros() - start);
+  Serial.println(F(" usec"));
+  if (readMlx(0x07, val)) {
+    Serial.print(F("Object temperature: "));
+    Serial.print(val*0.02 - 273.15);
+    Serial.println(F(" C"));
+  } else {
+    Serial.println(F("MLX90614: PEC error"));
+  }
+  delay(1000);
+}
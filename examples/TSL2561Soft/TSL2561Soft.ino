@@ -18,10 +18,15 @@
 #endif
 
 #include <SoftI2CMaster.h>
+#include <SoftI2CTransaction.h>
 #include "TSL2561Soft.h"
 
 #define ADDR 0x72
 
+// read the two bytes of the data registers of channel 0 and 1, respectively
+typedef I2CTransaction< I2CWrite<ADDR, 0x8C>, I2CRead<ADDR, 2> > ReadChannel0;
+typedef I2CTransaction< I2CWrite<ADDR, 0x8E>, I2CRead<ADDR, 2> > ReadChannel1;
+
 //------------------------------------------------------------------------------
 unsigned long computeLux(boolean gain, int intTime , unsigned long channel0, unsigned long channel1){
   
@@ -141,6 +146,7 @@ void loop (void) {
   unsigned int low0, high0, low1, high1;
   unsigned int chan0, chan1;
   unsigned int lux;
+  uint8_t buf[ReadChannel0::buffer_size];
 
   if (!i2c_start(ADDR | I2C_WRITE)) {
 #ifdef __AVR_ATmega328P__
@@ -159,18 +165,12 @@ void loop (void) {
   }
   i2c_stop();
   delay(600);
-  i2c_start(ADDR | I2C_WRITE);
-  i2c_write(0x8C);
-  i2c_rep_start(ADDR | I2C_READ);
-  low0 = i2c_read(false);
-  high0 = i2c_read(true);
-  i2c_stop();
-  i2c_start(ADDR | I2C_WRITE);
-  i2c_write(0x8E);
-  i2c_rep_start(ADDR | I2C_READ);
-  low1 = i2c_read(false);
-  high1 = i2c_read(true);
-  i2c_stop();
+  ReadChannel0::run(buf);
+  low0 = buf[0];
+  high0 = buf[1];
+  ReadChannel1::run(buf);
+  low1 = buf[0];
+  high1 = buf[1];
   i2c_start(ADDR | I2C_WRITE);
   if (!i2c_write(0x80)) {
 #ifdef __AVR_ATmega328P__
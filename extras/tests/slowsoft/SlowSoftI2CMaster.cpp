@@ -23,22 +23,43 @@ SlowSoftI2CMaster::SlowSoftI2CMaster(uint8_t sda, uint8_t scl) {
   _sda = sda;
   _scl = scl;
   _pullup = false;
+  _halfLoops = 0;
+#if I2C_FASTIO
+  resolve(_sda, _sdaMode, _sdaOut, _sdaIn, _sdaMask);
+  resolve(_scl, _sclMode, _sclOut, _sclIn, _sclMask);
+#endif
 }
 
 SlowSoftI2CMaster::SlowSoftI2CMaster(uint8_t sda, uint8_t scl, bool pullup) {
   _sda = sda;
   _scl = scl;
   _pullup = pullup;
+  _halfLoops = 0;
+#if I2C_FASTIO
+  resolve(_sda, _sdaMode, _sdaOut, _sdaIn, _sdaMask);
+  resolve(_scl, _sclMode, _sclOut, _sclIn, _sclMask);
+#endif
 }
+
 // Init function. Needs to be called once in the beginning.
 // Returns false if SDA or SCL are low, which probably means 
 // a I2C bus lockup or that the lines are not pulled up.
 bool SlowSoftI2CMaster::i2c_init(void) {
+  if (_pullup) {
+    // configures the pull-up hardware once, later only the
+    // output value and the direction are changed
+    pinMode(_sda, INPUT_PULLUP);
+    pinMode(_scl, INPUT_PULLUP);
+  } else {
+    pinMode(_sda, INPUT);
+    pinMode(_scl, INPUT);
+  }
   digitalWrite(_sda, LOW);
   digitalWrite(_scl, LOW);
   setHigh(_sda);
   setHigh(_scl);
-  if (digitalRead(_sda) == LOW || digitalRead(_scl) == LOW) return false;
+  calibrate();
+  if (!isHigh(_sda) || !isHigh(_scl)) return false;
   return true;
 }
 
@@ -47,7 +68,7 @@ bool SlowSoftI2CMaster::i2c_init(void) {
 // Return: true if the slave replies with an "acknowledge", false otherwise
 bool SlowSoftI2CMaster::i2c_start(uint8_t addr) {
   setLow(_sda);
-  delayMicroseconds(DELAY);
+  delayHalf();
   setLow(_scl);
   return i2c_write(addr);
 }
@@ -69,18 +90,18 @@ bool SlowSoftI2CMaster::i2c_start_wait(uint8_t addr) {
 bool SlowSoftI2CMaster::i2c_rep_start(uint8_t addr) {
   setHigh(_sda);
   setHigh(_scl);
-  delayMicroseconds(DELAY);
+  delayHalf();
   return i2c_start(addr);
 }
 
 // Issue a stop condition, freeing the bus.
 void SlowSoftI2CMaster::i2c_stop(void) {
   setLow(_sda);
-  delayMicroseconds(DELAY);
+  delayHalf();
   setHigh(_scl);
-  delayMicroseconds(DELAY);
+  delayHalf();
   setHigh(_sda);
-  delayMicroseconds(DELAY);
+  delayHalf();
 }
 
 // Write one byte to the slave chip that had been addressed
@@ -89,19 +110,20 @@ void SlowSoftI2CMaster::i2c_stop(void) {
 bool SlowSoftI2CMaster::i2c_write(uint8_t value) {
   for (uint8_t curr = 0X80; curr != 0; curr >>= 1) {
     if (curr & value) setHigh(_sda); else  setLow(_sda); 
+    delayHalf();
     setHigh(_scl);
-    delayMicroseconds(DELAY);
+    delayHalf();
     setLow(_scl);
   }
   // get Ack or Nak
   setHigh(_sda);
+  delayHalf();
   setHigh(_scl);
-  delayMicroseconds(DELAY/2);
-  uint8_t ack = digitalRead(_sda);
+  delayHalf();
+  bool ack = !isHigh(_sda);
   setLow(_scl);
-  delayMicroseconds(DELAY/2);  
   setLow(_sda);
-  return ack == 0;
+  return ack;
 }
 
 // Read one byte. If <last> is true, we send a NAK after having received 
@@ -111,20 +133,81 @@ uint8_t SlowSoftI2CMaster::i2c_read(bool last) {
   setHigh(_sda);
   for (uint8_t i = 0; i < 8; i++) {
     b <<= 1;
-    delayMicroseconds(DELAY);
+    delayHalf();
     setHigh(_scl);
-    if (digitalRead(_sda)) b |= 1;
+    delayHalf();
+    if (isHigh(_sda)) b |= 1;
     setLow(_scl);
   }
   if (last) setHigh(_sda); else setLow(_sda);
+  delayHalf();
   setHigh(_scl);
-  delayMicroseconds(DELAY/2);
+  delayHalf();
   setLow(_scl);
-  delayMicroseconds(DELAY/2);  
   setLow(_sda);
   return b;
 }
 
+// Busy wait for half a SCL period, the number of iterations
+// has been determined by calibrate()
+void SlowSoftI2CMaster::delayHalf(void) {
+  for (uint16_t i = _halfLoops; i > 0; i--)
+    __asm__ __volatile__ ("nop");
+}
+
+// Measure the speed of the delay loop in order to determine
+// the number of iterations for half a SCL period
+void SlowSoftI2CMaster::calibrate(void) {
+  const uint16_t probe = 10000;
+  unsigned long spent, loops;
+
+  _halfLoops = probe;
+  spent = micros();
+  delayHalf();
+  spent = micros() - spent;
+  if (spent == 0) spent = 1;
+  // (half period in nsec) * probe / (spent usec * 1000)
+  loops = (500000000UL/I2C_CLOCK) * (probe/100) / (spent*10);
+  _halfLoops = (loops > 0xFFFF ? 0xFFFF : loops);
+}
+
+#if I2C_FASTIO
+void SlowSoftI2CMaster::resolve(uint8_t pin, i2c_modereg_t &mode, i2c_outreg_t &out,
+				i2c_inreg_t &in, i2c_mask_t &mask) {
+  uint8_t port = digitalPinToPort(pin);
+  mode = portModeRegister(port);
+  out = portOutputRegister(port);
+  in = portInputRegister(port);
+  mask = digitalPinToBitMask(pin);
+}
+
+void SlowSoftI2CMaster::setLow(uint8_t pin) {
+  i2c_modereg_t mode = (pin == _sda ? _sdaMode : _sclMode);
+  i2c_outreg_t out = (pin == _sda ? _sdaOut : _sclOut);
+  i2c_mask_t mask = (pin == _sda ? _sdaMask : _sclMask);
+  noInterrupts();
+  if (_pullup) 
+    *out &= ~mask;
+  *mode |= mask;
+  interrupts();
+}
+
+void SlowSoftI2CMaster::setHigh(uint8_t pin) {
+  i2c_modereg_t mode = (pin == _sda ? _sdaMode : _sclMode);
+  i2c_outreg_t out = (pin == _sda ? _sdaOut : _sclOut);
+  i2c_mask_t mask = (pin == _sda ? _sdaMask : _sclMask);
+  noInterrupts();
+  *mode &= ~mask;
+  if (_pullup) 
+    *out |= mask;
+  interrupts();
+}
+
+bool SlowSoftI2CMaster::isHigh(uint8_t pin) {
+  if (pin == _sda) return (*_sdaIn & _sdaMask) != 0;
+  return (*_sclIn & _sclMask) != 0;
+}
+#else
 void SlowSoftI2CMaster::setLow(uint8_t pin) {
     noInterrupts();
     if (_pullup) 
@@ -143,3 +226,7 @@ void SlowSoftI2CMaster::setHigh(uint8_t pin) {
     interrupts();
 }
 
+bool SlowSoftI2CMaster::isHigh(uint8_t pin) {
+  return digitalRead(pin) != LOW;
+}
+#endif
@@ -24,10 +24,27 @@
 
 #define I2C_READ 1
 #define I2C_WRITE 0
-#define DELAY 4 // usec delay
+#define I2C_CLOCK 100000UL // SCL frequency in Hz
 #define BUFFER_LENGTH 32
 #define I2C_MAXWAIT 5000
 
+// If the core provides the port manipulation macros, the pins are resolved
+// once to register pointers and bit masks. Otherwise digitalWrite/pinMode are used.
+#if defined(portModeRegister) && defined(portOutputRegister) && \
+  defined(portInputRegister) && defined(digitalPinToPort) && defined(digitalPinToBitMask)
+#define I2C_FASTIO 1
+typedef decltype(portModeRegister(digitalPinToPort(0))) i2c_modereg_t;
+typedef decltype(portOutputRegister(digitalPinToPort(0))) i2c_outreg_t;
+typedef decltype(portInputRegister(digitalPinToPort(0))) i2c_inreg_t;
+#ifdef __AVR__
+typedef uint8_t i2c_mask_t;
+#else
+typedef uint32_t i2c_mask_t;
+#endif
+#else
+#define I2C_FASTIO 0
+#endif
+
 class SlowSoftI2CMaster {
  public:
   SlowSoftI2CMaster(uint8_t sda, uint8_t scl);
@@ -44,9 +61,21 @@ class SlowSoftI2CMaster {
  private:
   void setHigh(uint8_t pin);
   void setLow(uint8_t pin);
+  bool isHigh(uint8_t pin);
+  void delayHalf(void);
+  void calibrate(void);
   uint8_t _sda;
   uint8_t _scl;
   bool _pullup;
+  uint16_t _halfLoops; // spin loop iterations for half a SCL period
+#if I2C_FASTIO
+  void resolve(uint8_t pin, i2c_modereg_t &mode, i2c_outreg_t &out,
+	       i2c_inreg_t &in, i2c_mask_t &mask);
+  i2c_modereg_t _sdaMode, _sclMode;
+  i2c_outreg_t _sdaOut, _sclOut;
+  i2c_inreg_t _sdaIn, _sclIn;
+  i2c_mask_t _sdaMask, _sclMask;
+#endif
 };
 
 #endif
@@ -0,0 +1,299 @@
+/*
+  SoftI2CLog.h - Log-structured record store on I2C EEPROMs for SoftI2CMaster
+  Copyright (c) 2026 Bernhard Nebel.
+
+  This file is part of SoftI2CMaster https://github.com/felias-fogg/SoftI2CMaster.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef _SoftI2CLog_h
+#define _SoftI2CLog_h
+
+#include <inttypes.h>
+
+// Geometry of the EEPROM, default: 24AA1025/24LC1025 (128 kB, two blocks of
+// 64 kB selected by bit 3 of the device address, 128-byte pages)
+#ifndef I2C_LOG_PAGESIZE
+  #define I2C_LOG_PAGESIZE 128
+#endif
+#ifndef I2C_LOG_PAGES
+  #define I2C_LOG_PAGES 1024
+#endif
+
+#if I2C_LOG_PAGESIZE < 16 || I2C_LOG_PAGESIZE > 256
+  #error I2C_LOG_PAGESIZE must be between 16 and 256
+#endif
+#if I2C_LOG_PAGES < 3 || I2C_LOG_PAGES > 2048
+  #error I2C_LOG_PAGES must be between 3 and 2048
+#endif
+#if I2C_LOG_PAGES * I2C_LOG_PAGESIZE > 0x20000L
+  #error SoftI2CLog.h addresses at most 128 kB
+#endif
+
+// Page 0 holds the superblock (magic, epoch, record size), which is only
+// written by format. All other pages form a ring of append-only pages, each
+// starting with a header (epoch, sequence number of its first record)
+// followed by as many records as fit. A record is a 4-byte timestamp and the
+// payload; the timestamp 0xFFFFFFFF marks an empty slot. Pages are filled
+// completely before the next one is started, so the page of a sequence number
+// can be computed, and all pages of both blocks are written equally often.
+#define I2C_LOG_HEADER 6
+#define I2C_LOG_EMPTY 0xFFFFFFFFUL
+
+class I2CLog {
+ public:
+  // <addr> is the 8-bit device address, <recsize> the size of the payload of a record
+  I2CLog(uint8_t addr, uint8_t recsize) :
+    _addr(addr), _recsize(recsize), _perpage((I2C_LOG_PAGESIZE - I2C_LOG_HEADER) / (recsize + 4)) { }
+  // start a new, empty log (writes the superblock, on a device without a log
+  // also an empty header into every page, which takes a few seconds)
+  bool format(void);
+  // locate the end of the log by a binary search over the page headers
+  // Return: false if there is no log with this record size
+  bool begin(void);
+  // append a record; timestamps must not decrease and must not be 0xFFFFFFFF
+  bool append(uint32_t ts, const uint8_t *data);
+  // read the record with sequence number <seq>
+  bool read(uint32_t seq, uint32_t &ts, uint8_t *data);
+  // sequence number of the first record with a timestamp >= <ts>
+  bool find(uint32_t ts, uint32_t &seq);
+  // sequence numbers of the oldest record still stored and of the next record
+  uint32_t first(void) { return _firstseq; }
+  uint32_t next(void) { return _headseq + _fill; }
+
+ private:
+  bool seek(uint16_t page, uint8_t offset, bool read);
+  bool readBytes(uint16_t page, uint8_t offset, void *buf, uint8_t len);
+  bool writeBytes(const void *buf, uint8_t len);
+  bool header(uint16_t page, uint16_t &epoch, uint32_t &seq);
+  uint32_t stamp(uint16_t page, uint8_t slot);
+  uint16_t pageOf(uint32_t seq);
+
+  uint8_t _addr, _recsize, _perpage, _fill;
+  uint16_t _epoch, _head, _tail;
+  uint32_t _headseq, _firstseq;
+};
+
+#if !defined(USE_SOFTI2CLOG_H_AS_PLAIN_INCLUDE)
+/*
+ * The implementation part of the header only library starts here
+ */
+#include <SoftI2CMaster.h>
+#include <string.h>
+
+#define I2C_LOG_MAGIC 0x4C4F4731UL // "LOG1"
+
+// address <offset> of <page> for reading or writing; the caller transfers
+// the data and sends the stop condition
+bool I2CLog::seek(uint16_t page, uint8_t offset, bool read)
+{
+  uint32_t addr = (uint32_t)page * I2C_LOG_PAGESIZE + offset;
+  uint8_t dev = _addr | (addr & 0x10000 ? 8 : 0);
+
+  return i2c_start_wait(dev | I2C_WRITE) && // waits for the end of the last write cycle
+    i2c_write((addr >> 8) & 0xFF) && i2c_write(addr & 0xFF) &&
+    (!read || i2c_rep_start(dev | I2C_READ));
+}
+
+bool I2CLog::readBytes(uint16_t page, uint8_t offset, void *buf, uint8_t len)
+{
+  uint8_t *p = (uint8_t *)buf;
+  bool ok = seek(page, offset, true);
+  if (ok)
+    while (len--) *p++ = i2c_read(len == 0);
+  i2c_stop();
+  return ok;
+}
+
+bool I2CLog::writeBytes(const void *buf, uint8_t len)
+{
+  const uint8_t *p = (const uint8_t *)buf;
+  while (len--)
+    if (!i2c_write(*p++)) return false;
+  return true;
+}
+
+bool I2CLog::header(uint16_t page, uint16_t &epoch, uint32_t &seq)
+{
+  uint8_t buf[I2C_LOG_HEADER];
+  if (!readBytes(page, 0, buf, I2C_LOG_HEADER)) return false;
+  memcpy(&epoch, buf, 2);
+  memcpy(&seq, buf + 2, 4);
+  return epoch == _epoch;
+}
+
+uint32_t I2CLog::stamp(uint16_t page, uint8_t slot)
+{
+  uint32_t ts = I2C_LOG_EMPTY;
+  readBytes(page, I2C_LOG_HEADER + slot * (_recsize + 4), &ts, 4);
+  return ts;
+}
+
+uint16_t I2CLog::pageOf(uint32_t seq)
+{
+  uint32_t page = _tail + (seq - _firstseq) / _perpage;
+  if (page >= I2C_LOG_PAGES) page -= I2C_LOG_PAGES - 1;
+  return page;
+}
+
+bool I2CLog::format(void)
+{
+  uint32_t magic;
+  uint16_t page;
+  uint8_t i;
+  bool ok = true;
+
+  if (_perpage == 0 || !readBytes(0, 0, &magic, 4) || !readBytes(0, 4, &_epoch, 2)) return false;
+  if (magic == I2C_LOG_MAGIC) { // all other pages carry an older epoch
+    if (++_epoch == 0xFFFF) _epoch = 0; // 0xFFFF is the epoch of an erased header
+  } else { // unknown contents, e.g., all zeros: erase every page header
+    _epoch = 0;
+    for (page = 1; ok && page < I2C_LOG_PAGES; page++) {
+      ok = seek(page, 0, false);
+      for (i = 0; ok && i < I2C_LOG_HEADER; i++) ok = i2c_write(0xFF);
+      i2c_stop();
+    }
+  }
+  magic = I2C_LOG_MAGIC; // the superblock comes last, so an interrupted format is repeated
+  ok = ok && seek(0, 0, false) && writeBytes(&magic, 4) && writeBytes(&_epoch, 2) && writeBytes(&_recsize, 1);
+  i2c_stop();
+  _head = 0; // no page yet
+  _tail = 1;
+  _fill = _perpage;
+  _headseq = 0 - _perpage;
+  _firstseq = 0;
+  return ok;
+}
+
+bool I2CLog::begin(void)
+{
+  uint32_t magic, seq, seq1;
+  uint16_t epoch, lo, hi, mid;
+  uint8_t recsize;
+
+  if (_perpage == 0 || !readBytes(0, 0, &magic, 4) || !readBytes(0, 4, &_epoch, 2) ||
+      !readBytes(0, 6, &recsize, 1)) return false;
+  if (magic != I2C_LOG_MAGIC || recsize != _recsize) return false;
+  _head = 0;
+  _tail = 1;
+  _fill = _perpage;
+  _headseq = 0 - _perpage;
+  _firstseq = 0;
+  if (!header(1, epoch, seq1)) return true; // empty log
+  // pages 1 ... head belong to the current round, the following ones are
+  // older or unused: find the last page whose sequence number is >= that of page 1
+  lo = 1;
+  hi = I2C_LOG_PAGES - 1;
+  while (lo < hi) {
+    mid = lo + (hi - lo + 1) / 2;
+    if (header(mid, epoch, seq) && (int32_t)(seq - seq1) >= 0) lo = mid;
+    else hi = mid - 1;
+  }
+  _head = lo;
+  header(_head, epoch, _headseq);
+  if (_head < I2C_LOG_PAGES - 1 && header(_head + 1, epoch, seq)) {
+    _tail = _head + 1;
+    _firstseq = seq;
+  } else {
+    _firstseq = seq1;
+  }
+  // count the records in the head page
+  for (_fill = 0; _fill < _perpage && stamp(_head, _fill) != I2C_LOG_EMPTY; _fill++);
+  return true;
+}
+
+bool I2CLog::append(uint32_t ts, const uint8_t *data)
+{
+  bool newpage = (_fill == _perpage), ok;
+  uint16_t page = _head, tail = _tail, i;
+  uint32_t pageseq = _headseq, firstseq = _firstseq;
+
+  if (newpage) { // header, record, and empty slots in one page write
+    page = (_head == I2C_LOG_PAGES - 1 ? 1 : _head + 1);
+    pageseq += _perpage;
+    if (page == _tail && pageseq != _firstseq) { // the oldest page is overwritten
+      tail = (_tail == I2C_LOG_PAGES - 1 ? 1 : _tail + 1);
+      firstseq += _perpage;
+    }
+    ok = seek(page, 0, false) && writeBytes(&_epoch, 2) && writeBytes(&pageseq, 4);
+  } else {
+    ok = seek(page, I2C_LOG_HEADER + _fill * (_recsize + 4), false);
+  }
+  ok = ok && writeBytes(&ts, 4) && writeBytes(data, _recsize);
+  if (newpage)
+    for (i = I2C_LOG_HEADER + _recsize + 4; ok && i < I2C_LOG_PAGESIZE; i++) ok = i2c_write(0xFF);
+  i2c_stop();
+  if (!ok) return false;
+  if (newpage) { // only a completed write moves head and tail
+    _head = page;
+    _headseq = pageseq;
+    _tail = tail;
+    _firstseq = firstseq;
+    _fill = 0;
+  }
+  _fill++;
+  return true;
+}
+
+bool I2CLog::read(uint32_t seq, uint32_t &ts, uint8_t *data)
+{
+  uint8_t *p = (uint8_t *)&ts;
+  uint8_t i;
+  bool ok;
+
+  if (seq - _firstseq >= next() - _firstseq) return false;
+  ok = seek(pageOf(seq), I2C_LOG_HEADER + ((seq - _firstseq) % _perpage) * (_recsize + 4), true);
+  if (ok) {
+    for (i = 0; i < 4; i++) *p++ = i2c_read(false);
+    for (i = 0; i < _recsize; i++) *data++ = i2c_read(i == _recsize - 1);
+  }
+  i2c_stop();
+  return ok;
+}
+
+bool I2CLog::find(uint32_t ts, uint32_t &seq)
+{
+  uint16_t pages, lo, hi, mid, page;
+  uint8_t slot;
+
+  if (next() == _firstseq) return false;
+  if (stamp(_tail, 0) >= ts) {
+    seq = _firstseq;
+    return true;
+  }
+  // binary search for the last page whose first record is older than ts
+  pages = (next() - _firstseq + _perpage - 1) / _perpage;
+  lo = 0;
+  hi = pages - 1;
+  while (lo < hi) {
+    mid = lo + (hi - lo + 1) / 2;
+    if (stamp(pageOf(_firstseq + (uint32_t)mid * _perpage), 0) < ts) lo = mid;
+    else hi = mid - 1;
+  }
+  page = pageOf(_firstseq + (uint32_t)lo * _perpage);
+  for (slot = 1; slot < _perpage; slot++) {
+    seq = _firstseq + (uint32_t)lo * _perpage + slot;
+    if (seq == next()) return false;
+    if (stamp(page, slot) >= ts) return true;
+  }
+  seq = _firstseq + (uint32_t)(lo + 1) * _perpage;
+  return seq != next();
+}
+
+#endif // !defined(USE_SOFTI2CLOG_H_AS_PLAIN_INCLUDE)
+
+#endif // #ifndef _SoftI2CLog_h
+#pragma once
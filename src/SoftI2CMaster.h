@@ -1,6 +1,6 @@
 /* Arduino SoftI2C library.
  *
- * Version 2.1.9
+ * Version 2.2.0
  *
  * Copyright (C) 2013-2025, Bernhard Nebel and Peter Fleury
  *
@@ -54,12 +54,49 @@
  *   for communicating with SMbus devices, which have timeouts.
  *   Note, however, that interrupts are disabled from issuing a start condition
  *   until issuing a stop condition. So use this option with care!
+ *   With I2C_NOINTERRUPT = 2, interrupts are only disabled while transferring
+ *   a byte, so that the interrupt latency is bounded by I2C_MAX_IRQ_LATENCY.
  * - I2C_TIMEOUT = 0..10000 msec in order to return from the I2C functions
  *   in case of a I2C bus lockup (i.e., SCL constantly low). 0 means no timeout.
  * - I2C_MAXWAIT = 0..32767 number of retries in i2c_start_wait. 0 means never stop.
+ * - I2C_SCAN_TIMEOUT = 1..10000 usec a slave may stretch SCL while being probed
+ *   by i2c_probe/i2c_scan.
+ * - I2C_SLEEPWAIT = 1 in order to put the MCU into idle sleep mode while waiting
+ *   for busy devices or clock stretching slaves.
+ * - I2C_MAJORITY = 1 in order to sample SDA three times per received bit and
+ *   acknowledge and to take the majority (for long, noisy buses).
+ * - I2C_SPEEDSWITCH = 1 in order to run each device at its own speed
+ *   (see i2c_set_speed and i2c_negotiate_speed).
  */
 
 /* Changelog:
+ * Version 2.2.0
+ * - added i2c_probe and i2c_scan for fast bus enumeration
+ * - added I2C_SLEEPWAIT: idle sleep while polling busy devices and during long clock stretches
+ * - added I2C_NOINTERRUPT = 2: interrupts are only disabled while a byte is transferred
+ * - added SoftI2CStream.h with i2c_read_stream for overlapping bus reads and serial output
+ * - added i2c_write_P and i2c_write_PF for block writes straight from flash
+ * - added I2C_TIMERCLOCK: SCL half periods paced by a hardware timer
+ * - added I2C_SCL_PUSHPULL: SCL actively driven, no clock stretching checks
+ * - SDA and SCL can now be on ports outside the I/O space (port H and above on the ATmega2560)
+ * - added support for AVRxt MCUs (tinyAVR 0/1/2-series, megaAVR 0-series): VPORT registers
+ *   for the bit-banging version and the new TWI peripheral for I2C_HARDWARE
+ * - added I2C_GC_UNUSED: functions that are not called are not linked; i2c_probe and
+ *   i2c_write_P(F) are protected against interprocedural optimizations
+ * - added I2C_UNROLL: unrolled bit loops with inline delays in i2c_write and i2c_read
+ * - added I2C_LOWCLOCK: unrolled bit loops that check for clock stretching only
+ *   at byte boundaries, and I2C_SCL_FREQ, the resulting bus frequency
+ * - added I2C_STRETCH_CHECK: clock stretching checked at every bit, at byte boundaries or never
+ * - added SoftI2CTransaction.h: transactions described as types, checked at compile time
+ * - added SoftI2CScript.h: bytecode for I2C transactions and an interpreter running
+ *   it from RAM, flash, or EEPROM
+ * - added SoftI2CShadow.h: RAM copies of configuration registers, written only on changes
+ * - added SoftI2CScheduler.h: deadline-driven polling of several devices
+ * - added SoftI2CMux.h: devices behind a TCA9548A, channel selected only when it changes
+ * - added SoftI2CLog.h: append-only record log on large EEPROMs with lookup by sequence number and timestamp
+ * - added I2C_MAJORITY: majority of three SDA samples for received bits and acknowledges
+ * - added I2C_SPEEDSWITCH with i2c_set_speed and i2c_negotiate_speed: bus speed per device
+ * - added i2c_rise_time and i2c_max_scl_khz: rise time of SDA and SCL and the resulting maximal bus frequency
  * Version 2.1.9
  * - ArminJo: added cli-version line in CI
  * - ArminJo: changed position of guard 
@@ -101,27 +138,50 @@
 #else
 
 #include <avr/io.h>
+#include <avr/pgmspace.h>
 #include <Arduino.h>
 #include <util/twi.h>
 
+// The compiler does not see that the asm bodies of the functions read the
+// parameters and set the return values. So it must not apply
+// interprocedural optimizations to calls of them (I2C_NOIPA).
+#if __GNUC__ >= 8
+#define I2C_NOIPA __attribute__ ((noipa))
+#else
+#define I2C_NOIPA __attribute__ ((noclone))
+#endif
+
+// The basic functions are marked as "used" so that they are always
+// compiled. If I2C_GC_UNUSED is 1, the ones not called are discarded
+// by the compiler and linker instead.
+#ifndef I2C_GC_UNUSED
+#define I2C_GC_UNUSED 0
+#endif
+
+#if I2C_GC_UNUSED
+#define I2C_API I2C_NOIPA
+#else
+#define I2C_API __attribute__ ((used))
+#endif
+
 // Init function. Needs to be called once in the beginning.
 // Returns false if SDA or SCL are low, which probably means
 // a I2C bus lockup or that the lines are not pulled up.
-bool __attribute__ ((noinline)) i2c_init(void) __attribute__ ((used));
+bool __attribute__ ((noinline)) i2c_init(void) I2C_API;
 
 // Start transfer function: <addr> is the 8-bit I2C address (including the R/W
 // bit).
 // Return: true if the slave replies with an "acknowledge", false otherwise
-bool __attribute__ ((noinline)) i2c_start(uint8_t addr) __attribute__ ((used));
+bool __attribute__ ((noinline)) i2c_start(uint8_t addr) I2C_API;
 
 // Similar to start function, but wait for an ACK! Will timeout if I2C_MAXWAIT > 0.
-bool  __attribute__ ((noinline)) i2c_start_wait(uint8_t addr) __attribute__ ((used));
+bool  __attribute__ ((noinline)) i2c_start_wait(uint8_t addr) I2C_API;
 
 // Repeated start function: After having claimed the bus with a start condition,
 // you can address another or the same chip again without an intervening
 // stop condition.
 // Return: true if the slave replies with an "acknowledge", false otherwise
-bool __attribute__ ((noinline)) i2c_rep_start(uint8_t addr) __attribute__ ((used));
+bool __attribute__ ((noinline)) i2c_rep_start(uint8_t addr) I2C_API;
 
 // Issue a stop condition, freeing the bus.
 void __attribute__ ((noinline)) i2c_stop(void) asm("ass_i2c_stop") __attribute__ ((used));
@@ -133,7 +193,63 @@ bool __attribute__ ((noinline)) i2c_write(uint8_t value) asm("ass_i2c_write") __
 
 // Read one byte. If <last> is true, we send a NAK after having received
 // the byte in order to terminate the read sequence.
-uint8_t __attribute__ ((noinline)) i2c_read(bool last) __attribute__ ((used));
+uint8_t __attribute__ ((noinline)) i2c_read(bool last) I2C_API;
+
+// Block write functions: send <len> bytes from flash memory, either from
+// <data> in the lower 64k (PROGMEM) or from the far address <data>
+// (pgm_get_far_address) on MCUs with more than 64k of flash.
+// Return: true if all bytes have been acknowledged, false otherwise. The
+// transfer is stopped at the first NAK.
+bool __attribute__ ((noinline)) i2c_write_P(const uint8_t *data, uint16_t len) I2C_NOIPA;
+#ifdef RAMPZ
+bool __attribute__ ((noinline)) i2c_write_PF(uint_farptr_t data, uint16_t len) I2C_NOIPA;
+#endif
+
+// Probe function: sends a start condition, the 8-bit address <addr> and a
+// stop condition right after the acknowledge bit. Clock stretching is only
+// tolerated for I2C_SCAN_TIMEOUT usec.
+// Return: true if the slave replies with an "acknowledge", false otherwise
+bool __attribute__ ((noinline)) i2c_probe(uint8_t addr) I2C_NOIPA;
+
+// Scan the bus for 7-bit addresses <first>..<last> using i2c_probe. Bit
+// (addr&7) of <map>[addr>>3] is set if a device answered, i.e., <map> has
+// to have room for 16 bytes.
+// Return: false if SDA or SCL got stuck low while scanning, true otherwise
+bool i2c_scan(uint8_t *map, uint8_t first = 0x08, uint8_t last = 0x77);
+
+// Bus speeds of single devices (only with I2C_SPEEDSWITCH)
+#define I2C_SPEED_DEFAULT  0 // the mode selected by I2C_FASTMODE/I2C_SLOWMODE
+#define I2C_SPEED_SLOW     1 // 25 kHz
+#define I2C_SPEED_STANDARD 2 // 100 kHz
+#define I2C_SPEED_FAST     3 // 400 kHz
+
+#if defined(I2C_SPEEDSWITCH) && I2C_SPEEDSWITCH
+// Record the speed of the device with the 8-bit address <addr> (the R/W bit
+// is ignored). i2c_start, i2c_rep_start, i2c_start_wait, and i2c_probe
+// switch to the speed of the device they address.
+void i2c_set_speed(uint8_t addr, uint8_t speed);
+uint8_t i2c_get_speed(uint8_t addr);
+
+// Try fast, standard, and slow mode in this order until <verify>(addr)
+// succeeds <tries> times in a row, and record this speed for <addr>.
+// <verify> has to do a complete transaction (ending with i2c_stop) and check
+// the data, e.g., by reading back a register with a known value.
+// Return: the speed found, I2C_SPEED_DEFAULT if the device failed at all speeds
+uint8_t i2c_negotiate_speed(uint8_t addr, bool (*verify)(uint8_t addr), uint8_t tries = 8);
+#endif
+
+#if !defined(I2C_HARDWARE) || !I2C_HARDWARE
+// Rise time measurement (not with I2C_HARDWARE): SDA (<scl> false) or SCL
+// (<scl> true) is pulled low and released, and the CPU cycles until the
+// input reads high are counted. Call it only while the bus is idle.
+// Return: estimated rise time from 30% to 70% of VDD in ns, assuming an RC
+// curve; 0xFFFF if the line did not go high (0 for SCL with I2C_SCL_PUSHPULL)
+uint16_t i2c_rise_time(bool scl);
+#endif
+
+// Highest SCL frequency in kHz that the rise time <rise> in ns allows:
+// 400 (fast mode), 100 (standard mode), 25 (slow mode), or less
+uint16_t i2c_max_scl_khz(uint16_t rise);
 
 #if !defined(USE_SOFT_I2C_MASTER_H_AS_PLAIN_INCLUDE)
 #ifndef _SOFTI2C_HPP
@@ -151,10 +267,16 @@ uint8_t __attribute__ ((noinline)) i2c_read(bool last) __attribute__ ((used));
 #endif
 
 #if I2C_HARDWARE
-#ifndef TWDR
+#if defined(TWI0)
+// the TWI peripheral of the AVRxt MCUs (tinyAVR 0/1/2-series, megaAVR 0-series)
+#define I2C_HARDWARE_XT 1
+#elif !defined(TWDR)
 #error This chip does not support hardware I2C. Please undefine I2C_HARDWARE
 #endif
 #endif
+#ifndef I2C_HARDWARE_XT
+#define I2C_HARDWARE_XT 0
+#endif
 
 // You can set I2C_CPUFREQ independently of F_CPU if you
 // change the CPU frequency on the fly. If you do not define it,
@@ -190,8 +312,83 @@ uint8_t __attribute__ ((noinline)) i2c_read(bool last) __attribute__ ((used));
 // you are communicating with a SMBus device, and you want to avoid timeouts.
 // Be aware that the interrupt bit is enabled after each call. So the
 // I2C functions should not be called in interrupt routines or critical regions.
+// If I2C_NOINTERRUPT is 2, then interrupts are only disabled inside i2c_write,
+// i2c_read and i2c_probe, i.e., while SCL may be high, and the previous IRQ state
+// is restored afterwards. Between bytes, SCL is low, which SMBus devices
+// tolerate for milliseconds.
 #ifndef I2C_NOINTERRUPT
 #define I2C_NOINTERRUPT 0
+#else
+#if I2C_NOINTERRUPT > 2 || I2C_NOINTERRUPT < 0
+#error Illegal I2C_NOINTERRUPT value
+#endif
+#endif
+
+// If I2C_SCL_PUSHPULL is 1, SCL is an output all the time and is driven high and
+// low through the PORT bit instead of being released to the pull-up. This gives
+// steep edges, and the checks for clock stretching are left out. Use it only with
+// a single master and slaves that never stretch the clock, since a slave pulling
+// SCL low would short the output. SDA stays open-drain.
+#ifndef I2C_SCL_PUSHPULL
+#define I2C_SCL_PUSHPULL 0
+#endif
+
+// If I2C_UNROLL is 1, i2c_write and i2c_read are compiled for speed instead of
+// size: the loop over the 8 data bits is unrolled and the delay loops are inlined,
+// so no cycles are lost for calls and returns inside a byte. This costs roughly
+// 500 bytes of flash, but gives much higher bus frequencies on slowly clocked MCUs.
+#ifndef I2C_UNROLL
+#define I2C_UNROLL 0
+#endif
+
+// I2C_LOWCLOCK = 1 is meant for MCUs running at 1 MHz or so. It implies I2C_UNROLL,
+// and by default clock stretching is only checked at the first bit of a byte and
+// at the acknowledge bit (I2C_STRETCH_CHECK = 1). Then a data bit takes only
+// 10 CPU cycles, i.e., at 1 MHz the bus runs at 100 kHz.
+#ifndef I2C_LOWCLOCK
+#define I2C_LOWCLOCK 0
+#endif
+
+#if I2C_LOWCLOCK
+#undef I2C_UNROLL
+#define I2C_UNROLL 1
+#endif
+
+// I2C_STRETCH_CHECK selects where i2c_write and i2c_read check for clock
+// stretching: 2 means at every bit, 1 only at the first bit of a byte and at
+// the acknowledge bit, which is where slaves usually stretch the clock, and 0
+// means never. Each check costs a few cycles per bit. With I2C_SCL_PUSHPULL,
+// it is always 0.
+#ifndef I2C_STRETCH_CHECK
+#if I2C_LOWCLOCK
+#define I2C_STRETCH_CHECK 1
+#else
+#define I2C_STRETCH_CHECK 2
+#endif
+#else
+#if I2C_STRETCH_CHECK > 2 || I2C_STRETCH_CHECK < 0
+#error Illegal I2C_STRETCH_CHECK value
+#endif
+#endif
+
+#if I2C_SCL_PUSHPULL
+#undef I2C_STRETCH_CHECK
+#define I2C_STRETCH_CHECK 0
+#endif
+
+// If I2C_MAJORITY is 1, i2c_read and the acknowledge check of i2c_write sample
+// SDA three times while SCL is high and take the majority, so that a short
+// glitch on a long bus does not flip the bit: right after SCL has gone high,
+// after the half period delay, and 4 cycles later. Clock stretching is then
+// checked before the delay instead of after it. The samples are counted in r20.
+// A bit read takes 7 cycles more (9 with I2C_UNROLL), the acknowledge bit of
+// a write 9 cycles more; the SCL high phase gets longer by this amount.
+#ifndef I2C_MAJORITY
+#define I2C_MAJORITY 0
+#else
+#if I2C_MAJORITY > 1 || I2C_MAJORITY < 0
+#error Illegal I2C_MAJORITY value
+#endif
 #endif
 
 // I2C_TIMEOUT can be set to a value between 1 and 10000.
@@ -214,6 +411,49 @@ uint8_t __attribute__ ((noinline)) i2c_read(bool last) __attribute__ ((used));
 #endif
 #endif
 
+// I2C_SCAN_TIMEOUT can be set to a value between 1 and 10000 (usec).
+// It limits clock stretching while probing devices, so that scanning
+// for absent devices does not take the general I2C_TIMEOUT. The time the
+// bus needs for the probe itself is not included in this limit.
+#ifndef I2C_SCAN_TIMEOUT
+#define I2C_SCAN_TIMEOUT 500
+#else
+#if I2C_SCAN_TIMEOUT > 10000 || I2C_SCAN_TIMEOUT < 1
+#error Illegal I2C_SCAN_TIMEOUT value
+#endif
+#endif
+
+// If I2C_SLEEPWAIT is 1, then the MCU sleeps in idle mode between two polls in
+// i2c_start_wait and while a slave stretches SCL for longer than
+// I2C_SLEEPWAIT_SPIN usec (1..10000). It is woken up by the next interrupt, usually
+// the millis() timer. If you also define I2C_SCL_PCMSK, I2C_SCL_PCINT, I2C_SCL_PCIE
+// and I2C_SCL_PCINT_vect, a pin change interrupt on SCL wakes up the MCU as soon as
+// SCL is released. Sleeping during clock stretching needs interrupts, so it is
+// not done if I2C_NOINTERRUPT is set.
+#ifndef I2C_SLEEPWAIT
+#define I2C_SLEEPWAIT 0
+#endif
+
+#ifndef I2C_SLEEPWAIT_SPIN
+#define I2C_SLEEPWAIT_SPIN 100
+#else
+#if I2C_SLEEPWAIT_SPIN > 10000 || I2C_SLEEPWAIT_SPIN < 1
+#error Illegal I2C_SLEEPWAIT_SPIN value
+#endif
+#endif
+
+// If I2C_TIMERCLOCK is 1, the SCL half periods are timed by a hardware timer
+// in CTC mode instead of by the delay loop. Each delay restarts the counter and
+// waits for the compare match, so a half period never gets shorter than
+// SCL_CLOCK demands: an interrupt only lengthens the phase it hits. The bus
+// clock is then SCL_CLOCK up to the granularity of the timer prescaler. By
+// default, timer 2 is used (so tone() is not available). You can use another
+// timer by defining I2C_TIMER_TIFR, I2C_TIMER_OCF, and I2C_TIMER_TCNT and
+// setting it up yourself with a period of I2C_TIMER_RUN CPU cycles.
+#ifndef I2C_TIMERCLOCK
+#define I2C_TIMERCLOCK 0
+#endif
+
 #define I2C_TIMEOUT_DELAY_LOOPS (I2C_CPUFREQ/1000UL)*I2C_TIMEOUT/4000UL
 #if I2C_TIMEOUT_DELAY_LOOPS < 1
 #define I2C_MAX_STRETCH 1
@@ -225,75 +465,545 @@ uint8_t __attribute__ ((noinline)) i2c_read(bool last) __attribute__ ((used));
 #endif
 #endif
 
+// one iteration of the spin loop before going to sleep takes 5 cycles
+#define I2C_SLEEPWAIT_LOOPS ((I2C_CPUFREQ/1000UL)*I2C_SLEEPWAIT_SPIN/5000UL + 1)
+
+// one iteration of the probe stretch loop takes roughly 6 cycles, plus
+// one iteration for each of the 11 SCL high phases of a probe
+#define I2C_SCAN_STRETCH ((I2C_CPUFREQ/1000UL)*I2C_SCAN_TIMEOUT/6000UL + 16)
+
+// with I2C_HARDWARE, i2c_probe can only wait for a whole bus phase of <bits>
+// SCL periods, so their nominal time (and the 4 usec resolution of micros)
+// is added to the stretch budget
+#define I2C_SCAN_PHASE(bits) (I2C_SCAN_TIMEOUT + (bits)*1000000UL/SCL_CLOCK + 4)
+
+// Cycles per half period in the bit loops without the delay loop. On AVRxt
+// MCUs, sbi, cbi, call and rcall take one cycle less than the cycle counts
+// given in the comments of the assembler code, which are for classic AVRs.
+// The unrolled bit loops (I2C_UNROLL) do not call the delay function.
+// I2C_BIT_OVERHEAD is the number of cycles of a data bit without any delay,
+// the checks for clock stretching take 3 (unrolled) or 6 cycles of it.
+#ifdef __AVR_XMEGA__
+#define I2C_XT_SAVING 3
+#else
+#define I2C_XT_SAVING 0
+#endif
+#if I2C_UNROLL
+#define I2C_CALL_CYCLES 0
+#define I2C_BIT_OVERHEAD ((I2C_STRETCH_CHECK == 2 ? 13 : 10) - I2C_XT_SAVING)
+#else
+#define I2C_CALL_CYCLES (I2C_XT_SAVING ? 6 : 7)
+#define I2C_BIT_OVERHEAD ((I2C_STRETCH_CHECK == 2 ? 20 : 14) - I2C_XT_SAVING)
+#endif
+#define I2C_LOOP_CYCLES (I2C_BIT_OVERHEAD/2 + I2C_CALL_CYCLES + 1)
+
+// cycles per SCL half period we aim at
+#define I2C_HALF_FAST ((I2C_CPUFREQ/350000L)/2)
+#define I2C_HALF_STANDARD ((I2C_CPUFREQ/90000L)/2)
+#define I2C_HALF_SLOW ((I2C_CPUFREQ/23500L)/2)
 #if I2C_FASTMODE
-#define I2C_DELAY_COUNTER (((I2C_CPUFREQ/350000L)/2-18)/3)
+#define I2C_HALF_TARGET I2C_HALF_FAST
 #define SCL_CLOCK 400000UL
 #else
 #if I2C_SLOWMODE
-#define I2C_DELAY_COUNTER (((I2C_CPUFREQ/23500L)/2-18)/3)
+#define I2C_HALF_TARGET I2C_HALF_SLOW
 #define SCL_CLOCK 25000UL
 #else
-#define I2C_DELAY_COUNTER (((I2C_CPUFREQ/90000L)/2-18)/3)
+#define I2C_HALF_TARGET I2C_HALF_STANDARD
 #define SCL_CLOCK 100000UL
 #endif
 #endif
 
+#define I2C_DELAY_COUNTER ((I2C_HALF_TARGET-I2C_LOOP_CYCLES)/3)
+
+#if I2C_TIMERCLOCK && !I2C_HARDWARE
+#ifdef __AVR_XMEGA__
+#error I2C_TIMERCLOCK is only supported on classic AVR MCUs
+#endif
+#define I2C_TIMER_HALF (I2C_CPUFREQ/(2*SCL_CLOCK))
+// the bit loops need roughly 25 cycles per half period themselves
+#if I2C_TIMER_HALF < 32
+#error I2C_TIMERCLOCK needs at least 32 CPU cycles per SCL half period
+#endif
+// the timed part of a half period, the rest is spent in the bit loops
+#define I2C_TIMER_RUN (I2C_TIMER_HALF - I2C_LOOP_CYCLES)
+#if I2C_TIMER_RUN < 1
+#error SCL_CLOCK is too high for I2C_TIMERCLOCK
+#endif
+#ifndef I2C_TIMER_TIFR
+#ifndef TCCR2A
+#error No timer 2: define I2C_TIMER_TIFR, I2C_TIMER_OCF, and I2C_TIMER_TCNT and set up the timer yourself
+#endif
+#define I2C_TIMER_SETUP 1
+#define I2C_TIMER_TIFR TIFR2
+#define I2C_TIMER_OCF OCF2A
+#define I2C_TIMER_TCNT TCNT2
+// round up, so that the timed part is never shorter than I2C_TIMER_RUN
+#if I2C_TIMER_RUN <= 256
+#define I2C_TIMER_CS _BV(CS20)
+#define I2C_TIMER_TOP (I2C_TIMER_RUN - 1)
+#elif I2C_TIMER_RUN <= 2048
+#define I2C_TIMER_CS _BV(CS21)
+#define I2C_TIMER_TOP ((I2C_TIMER_RUN+7)/8 - 1)
+#else
+#define I2C_TIMER_CS _BV(CS22)
+#define I2C_TIMER_TOP ((I2C_TIMER_RUN+63)/64 - 1)
+#endif
+#else
+#ifndef I2C_TIMER_TCNT
+#error I2C_TIMER_TCNT must be defined together with I2C_TIMER_TIFR
+#endif
+#define I2C_TIMER_SETUP 0
+#endif
+// the timer paces all half periods, so no delay call may be left out
+#if I2C_DELAY_COUNTER < 1
+#undef I2C_DELAY_COUNTER
+#define I2C_DELAY_COUNTER 1
+#endif
+#endif
+
+#if I2C_UNROLL && !I2C_HARDWARE
+#if I2C_TIMERCLOCK
+#error I2C_UNROLL cannot be combined with I2C_TIMERCLOCK
+#endif
+// Cycles the inline delay has to burn per half period: 3 per iteration of
+// the delay loop and up to 2 nops.
+#define I2C_UNROLL_BURN (I2C_HALF_TARGET > I2C_LOOP_CYCLES + I2C_PORT_CYCLES ? \
+                         I2C_HALF_TARGET - I2C_LOOP_CYCLES - I2C_PORT_CYCLES : 0)
+#define I2C_UNROLL_DELAY (I2C_UNROLL_BURN/3)
+#define I2C_UNROLL_PAD (I2C_UNROLL_BURN%3)
+#endif
+
+// If I2C_SPEEDSWITCH is 1, the loop count of the delay function is read from
+// a variable instead of being a constant. i2c_start, i2c_rep_start,
+// i2c_start_wait, and i2c_probe set it to the speed recorded for the device
+// they address (see i2c_set_speed), so that fast devices can run at 400 kHz
+// on a bus shared with slower ones. Addresses without a recorded speed use
+// the mode selected at compile time. This costs 32 bytes of RAM, 1 cycle per
+// half period, and around 25 cycles per addressed device. It only works
+// with the normal bit loops.
+#ifndef I2C_SPEEDSWITCH
+#define I2C_SPEEDSWITCH 0
+#endif
+#if I2C_SPEEDSWITCH
+#if I2C_HARDWARE || I2C_UNROLL || I2C_TIMERCLOCK
+#error I2C_SPEEDSWITCH cannot be combined with I2C_HARDWARE, I2C_UNROLL, or I2C_TIMERCLOCK
+#endif
+// loop count of the delay function for a half period of <half> cycles
+#define I2C_SPEED_COUNT(half) ((half) >= I2C_LOOP_CYCLES + I2C_PORT_CYCLES + 4 ? \
+                               ((half) - I2C_LOOP_CYCLES - I2C_PORT_CYCLES - 1)/3 : 1)
+// a faster mode may need the delay calls left out by the default mode
+#if I2C_DELAY_COUNTER < 1
+#undef I2C_DELAY_COUNTER
+#define I2C_DELAY_COUNTER 1
+#endif
+#endif
+
 // constants for reading & writing
 #define I2C_READ    1
 #define I2C_WRITE   0
 
+// cycles of one call of i2c_delay_half inside the bit loops (X in the cycle comments)
+#if I2C_TIMERCLOCK && !I2C_HARDWARE
+#define I2C_HALF_CYCLES (I2C_CALL_CYCLES + I2C_TIMER_RUN)
+#elif I2C_SPEEDSWITCH
+#define I2C_HALF_CYCLES (I2C_CALL_CYCLES + 1 + 3*I2C_SPEED_COUNT(I2C_HALF_TARGET))
+#elif I2C_DELAY_COUNTER < 1
+#define I2C_HALF_CYCLES 0
+#else
+#define I2C_HALF_CYCLES (I2C_CALL_CYCLES + 3*I2C_DELAY_COUNTER)
+#endif
+
+// CPU cycles of a data bit written by i2c_write and the resulting SCL
+// frequency in Hz (without clock stretching and interrupts; for the default
+// speed with I2C_SPEEDSWITCH)
+#if I2C_HARDWARE
+#define I2C_BIT_CYCLES (I2C_CPUFREQ/SCL_CLOCK)
+#elif I2C_TIMERCLOCK
+#define I2C_BIT_CYCLES (2*I2C_TIMER_HALF)
+#elif I2C_UNROLL
+#define I2C_BIT_CYCLES (I2C_BIT_OVERHEAD + 2*(I2C_PORT_CYCLES + 3*I2C_UNROLL_DELAY + I2C_UNROLL_PAD))
+#else
+#define I2C_BIT_CYCLES (I2C_BIT_OVERHEAD + 2*I2C_HALF_CYCLES)
+#endif
+#define I2C_SCL_FREQ (I2C_CPUFREQ/I2C_BIT_CYCLES)
+
+// Maximal time in usec interrupts are disabled by the library (without clock
+// stretching): 0 if interrupts are never disabled, one byte transfer (plus
+// start and stop in case of i2c_probe) if I2C_NOINTERRUPT is 2. Not defined
+// for I2C_NOINTERRUPT = 1, since then it depends on the length of the transfer.
+#if I2C_HARDWARE || I2C_NOINTERRUPT == 0
+#define I2C_MAX_IRQ_LATENCY 0
+#elif I2C_NOINTERRUPT == 2
+#define I2C_MAX_IRQ_LATENCY ((11UL*(20 + 2*I2C_HALF_CYCLES) + 30)*1000000UL/I2C_CPUFREQ + 1)
+#endif
+
+#if I2C_SLEEPWAIT
+#include <avr/sleep.h>
+#include <avr/interrupt.h>
+
+#ifndef I2C_SCL_PCICR
+#ifdef PCICR
+#define I2C_SCL_PCICR PCICR
+#else
+#define I2C_SCL_PCICR GIMSK
+#endif
+#endif
+
+#ifdef I2C_SCL_PCINT_vect
+// only used for waking up the MCU
+EMPTY_INTERRUPT(I2C_SCL_PCINT_vect);
+#endif
+
+// Internal sleep functions.
+void __attribute__ ((noinline)) i2c_sleep_idle(void) asm("ass_i2c_sleep_idle") __attribute__ ((used));
+
+// Sleep in idle mode until the next interrupt. The sleep mode set by the
+// sketch and the IRQ state are restored afterwards.
+void i2c_sleep_idle(void)
+{
+  uint8_t sreg = SREG;
+  uint8_t sleepctrl = _SLEEP_CONTROL_REG;
+
+  set_sleep_mode(SLEEP_MODE_IDLE);
+  sleep_enable();
+  sei();
+  sleep_cpu();
+  sleep_disable();
+  _SLEEP_CONTROL_REG = sleepctrl;
+  SREG = sreg;
+}
+#endif // I2C_SLEEPWAIT
+
 #if !I2C_HARDWARE
 // map the IO register back into the IO address space
+#if defined(__AVR_XMEGA__) && defined(VPORTA_OUT)
+// AVRxt: SDA_PORT and SCL_PORT are VPORTx_OUT, followed by VPORTx_IN and
+// preceded by VPORTx_DIR
+#define SDA_DDR         (_SFR_IO_ADDR(SDA_PORT) - 1)
+#define SCL_DDR         (_SFR_IO_ADDR(SCL_PORT) - 1)
+#define SDA_OUT         _SFR_IO_ADDR(SDA_PORT)
+#define SCL_OUT         _SFR_IO_ADDR(SCL_PORT)
+#define SDA_IN      (_SFR_IO_ADDR(SDA_PORT) + 1)
+#define SCL_IN      (_SFR_IO_ADDR(SCL_PORT) + 1)
+#else
 #define SDA_DDR         (_SFR_IO_ADDR(SDA_PORT) - 1)
 #define SCL_DDR         (_SFR_IO_ADDR(SCL_PORT) - 1)
 #define SDA_OUT         _SFR_IO_ADDR(SDA_PORT)
 #define SCL_OUT         _SFR_IO_ADDR(SCL_PORT)
 #define SDA_IN      (_SFR_IO_ADDR(SDA_PORT) - 2)
 #define SCL_IN      (_SFR_IO_ADDR(SCL_PORT) - 2)
+#endif
 
 #ifndef __tmp_reg__
 #define __tmp_reg__ 0
 #endif
 
-// Internal delay functions.
+// All accesses to SDA and SCL go through the following assembler macros. For
+// ports in the I/O space, they are just sbi, cbi, sbis, and sbic. Ports above
+// (port H and above on the ATmega2560) are accessed with lds/sts. Setting or
+// clearing a bit is then a read-modify-write with interrupts disabled, which is
+// put into a small subroutine (one per register and bit) so that the bit loops
+// stay within branch range. It uses r18 and r19, which no primitive uses
+// otherwise, and takes 16 cycles more than sbi/cbi. Testing a bit is done inline
+// with lds/sbrs (2 cycles more) and still skips the next instruction. The
+// macros are defined by the first asm statement that is emitted, since the order
+// of functions in the assembler output is not fixed.
+#define I2C_PORT_MACROS \
+  ".ifndef __i2c_port_macros \n" \
+  ".set __i2c_port_macros, 1 \n" \
+  ".macro i2c_rmw op, reg, bit, val \n" \
+  " .ifndef __i2c_\\op\\()_\\reg\\()_\\bit \n" \
+  "  .pushsection .text.i2c_ports,\"ax\",@progbits \n" \
+  "__i2c_\\op\\()_\\reg\\()_\\bit: \n" \
+  "  in   r18, 0x3F \n" \
+  "  cli \n" \
+  "  lds  r19, \\reg + 0x20 \n" \
+  "  \\op  r19, \\val \n" \
+  "  sts  \\reg + 0x20, r19 \n" \
+  "  out  0x3F, r18 \n" \
+  "  ret \n" \
+  "  .popsection \n" \
+  " .endif \n" \
+  "  call __i2c_\\op\\()_\\reg\\()_\\bit \n" \
+  ".endm \n" \
+  ".macro i2c_sbi reg, bit \n" \
+  " .if \\reg < 0x20 \n" \
+  "  sbi \\reg, \\bit \n" \
+  " .else \n" \
+  "  i2c_rmw ori, \\reg, \\bit, (1 << \\bit) \n" \
+  " .endif \n" \
+  ".endm \n" \
+  ".macro i2c_cbi reg, bit \n" \
+  " .if \\reg < 0x20 \n" \
+  "  cbi \\reg, \\bit \n" \
+  " .else \n" \
+  "  i2c_rmw andi, \\reg, \\bit, (0xFF ^ (1 << \\bit)) \n" \
+  " .endif \n" \
+  ".endm \n" \
+  ".macro i2c_sbis reg, bit \n" \
+  " .if \\reg < 0x20 \n" \
+  "  sbis \\reg, \\bit \n" \
+  " .else \n" \
+  "  lds  r19, \\reg + 0x20 \n" \
+  "  sbrs r19, \\bit \n" \
+  " .endif \n" \
+  ".endm \n" \
+  ".macro i2c_sbic reg, bit \n" \
+  " .if \\reg < 0x20 \n" \
+  "  sbic \\reg, \\bit \n" \
+  " .else \n" \
+  "  lds  r19, \\reg + 0x20 \n" \
+  "  sbrc r19, \\bit \n" \
+  " .endif \n" \
+  ".endm \n" \
+  ".endif \n"
+
+// Additional cycles per half period caused by ports outside the I/O space in
+// the bit loops; they are subtracted from the delay loop.
+#define I2C_SCL_PORT_CYCLES (I2C_SCL_PUSHPULL ? 16 : (I2C_PULLUP ? 33 : 17))
+#define I2C_SDA_PORT_CYCLES (I2C_PULLUP ? 16 : 8)
+#define I2C_PORT_CYCLES ((SCL_OUT >= 0x20 ? I2C_SCL_PORT_CYCLES : 0) + \
+                         (SDA_OUT >= 0x20 ? I2C_SDA_PORT_CYCLES : 0))
+
+// Inline delay of a half period for the unrolled bit loops (I2C_UNROLL),
+// takes 3*DELAY + PAD cycles and clobbers r25
+#define I2C_INLINE_DELAY \
+  ".if %[DELAY] >= 1 \n\t" \
+  " ldi      r25,%[DELAY]            ;delay T/2 \n\t" \
+  "8: \n\t" \
+  " dec      r25 \n\t" \
+  " brne     8b \n\t" \
+  ".endif \n\t" \
+  ".rept %[PAD] \n\t" \
+  " nop \n\t" \
+  ".endr \n\t"
+
+// Internal delay functions. i2c_delay_half clobbers r25. i2c_wait_scl_high
+// returns with N=1 on a timeout and clobbers r0, r26, r27 (r25 as well with
+// I2C_TIMERCLOCK); with I2C_SLEEPWAIT, it saves all other call-clobbered
+// registers around the call of the C function i2c_sleep_scl_high.
 void __attribute__ ((noinline)) i2c_delay_half(void) asm("ass_i2c_delay_half")  __attribute__ ((used));
 void __attribute__ ((noinline)) i2c_wait_scl_high(void) asm("ass_i2c_wait_scl_high")  __attribute__ ((used));
 
+#if I2C_SPEEDSWITCH
+// Loop count of i2c_delay_half and the speeds of all 7-bit addresses, four
+// per byte with 2 bits each (I2C_SPEED_DEFAULT = 0 at the start)
+uint8_t i2c_delay_count asm("ass_i2c_delay_count") __attribute__ ((used)) = I2C_SPEED_COUNT(I2C_HALF_TARGET);
+uint8_t i2c_speed_map[32];
+
+void __attribute__ ((noinline)) i2c_speed_select(uint8_t addr) asm("ass_i2c_speed_select")  __attribute__ ((used));
+
+// Load i2c_delay_count for the device with the 8-bit address <addr>. It is
+// called (by I2C_SPEED_SELECT) at the entry of the functions that address a
+// device, where r24 is the only register in use.
+void i2c_speed_select(uint8_t addr)
+{
+  switch ((i2c_speed_map[addr >> 3] >> (addr & 6)) & 3) {
+  case I2C_SPEED_SLOW:
+    i2c_delay_count = I2C_SPEED_COUNT(I2C_HALF_SLOW);
+    break;
+  case I2C_SPEED_STANDARD:
+    i2c_delay_count = I2C_SPEED_COUNT(I2C_HALF_STANDARD);
+    break;
+  case I2C_SPEED_FAST:
+    i2c_delay_count = I2C_SPEED_COUNT(I2C_HALF_FAST);
+    break;
+  default:
+    i2c_delay_count = I2C_SPEED_COUNT(I2C_HALF_TARGET);
+  }
+}
+
+#if __AVR_HAVE_JMP_CALL__
+#define I2C_SPEED_SELECT \
+  " push     r24                     ;select speed of device \n\t" \
+  " call     ass_i2c_speed_select \n\t" \
+  " pop      r24 \n\t"
+#else
+#define I2C_SPEED_SELECT \
+  " push     r24                     ;select speed of device \n\t" \
+  " rcall    ass_i2c_speed_select \n\t" \
+  " pop      r24 \n\t"
+#endif
+#else
+#define I2C_SPEED_SELECT ""
+#endif
+
+#if I2C_SLEEPWAIT && !I2C_NOINTERRUPT
+bool __attribute__ ((noinline)) i2c_sleep_scl_high(void) asm("ass_i2c_sleep_scl_high") __attribute__ ((used));
+
+// Sleep until SCL is high (return true) or until I2C_TIMEOUT msec
+// have passed (return false).
+bool i2c_sleep_scl_high(void)
+{
+  bool high;
+  uint8_t sreg = SREG;
+  uint8_t sleepctrl = _SLEEP_CONTROL_REG;
+#if I2C_TIMEOUT
+  uint32_t start = millis();
+#endif
+#ifdef I2C_SCL_PCINT_vect
+  uint8_t pcmsk = I2C_SCL_PCMSK;
+  uint8_t pcicr = I2C_SCL_PCICR;
+
+  I2C_SCL_PCMSK |= _BV(I2C_SCL_PCINT);
+  I2C_SCL_PCICR |= _BV(I2C_SCL_PCIE);
+#endif
+  set_sleep_mode(SLEEP_MODE_IDLE);
+  while (true) {
+    cli(); // a pending wake-up IRQ is served right after the sleep instruction
+    high = (_SFR_IO8(SCL_IN) & _BV(SCL_PIN)) != 0;
+    if (high) break;
+#if I2C_TIMEOUT
+    if (millis() - start > I2C_TIMEOUT) break;
+#endif
+    sleep_enable();
+    sei();
+    sleep_cpu();
+    sleep_disable();
+  }
+#ifdef I2C_SCL_PCINT_vect
+  I2C_SCL_PCMSK = pcmsk;
+  I2C_SCL_PCICR = pcicr;
+#endif
+  _SLEEP_CONTROL_REG = sleepctrl;
+  SREG = sreg;
+  return high;
+}
+#endif
+
 void  i2c_delay_half(void)
 { // function call 3 cycles => 3C
-#if I2C_DELAY_COUNTER < 1
+#if I2C_TIMERCLOCK
+  __asm__ __volatile__
+    (
+     " ldi      r25, %[OCFMASK]         ;no flags are changed here \n\t"
+     " sts      %[TCNT],__zero_reg__    ;restart the period \n\t"
+     " out      %[TIFR],r25             ;clear stale compare match \n\t"
+     "_Litimer_wait: \n\t"
+     " in       __tmp_reg__,%[TIFR]     ;wait for compare match \n\t"
+     " sbrs     __tmp_reg__,%[OCF] \n\t"
+     " rjmp     _Litimer_wait \n\t"
+     " ret"
+     : : [TIFR] "I" (_SFR_IO_ADDR(I2C_TIMER_TIFR)), [OCF] "I" (I2C_TIMER_OCF),
+       [OCFMASK] "M" (_BV(I2C_TIMER_OCF)),
+       [TCNT] "n" (_SFR_MEM_ADDR(I2C_TIMER_TCNT)) : "r25");
+#elif I2C_SPEEDSWITCH
+  __asm__ __volatile__
+    (
+     " lds      r25, ass_i2c_delay_count ;load delay count     ;; 5C \n\t"
+     "_Lidelay: \n\t"
+     " dec r25                          ;decrement counter \n\t"
+     " brne _Lidelay \n\t"
+     " ret                                                     ;; 8C+xC"
+     : : : "r25");
+  // 8 cycles + 3 times x cycles
+#elif I2C_DELAY_COUNTER < 1
   __asm__ __volatile__ (" ret");
   // 7 cycles for call and return
 #else
   __asm__ __volatile__
     (
+     ".if %[DELAY] < 1                  ;slow port accesses took all the time \n\t"
+     " ret \n\t"
+     ".else \n\t"
      " ldi      r25, %[DELAY]           ;load delay constant   ;; 4C \n\t"
      "_Lidelay: \n\t"
      " dec r25                          ;decrement counter     ;; 4C+xC \n\t"
      " brne _Lidelay                                           ;;5C+(x-1)2C+xC\n\t"
-     " ret                                                     ;; 9C+(x-1)2C+xC = 7C+xC"
-     : : [DELAY] "M" I2C_DELAY_COUNTER : "r25");
+     " ret                                                     ;; 9C+(x-1)2C+xC = 7C+xC \n\t"
+     ".endif"
+     : : [DELAY] "n" (I2C_DELAY_COUNTER - (I2C_PORT_CYCLES + 1)/3) : "r25");
   // 7 cycles + 3 times x cycles
 #endif
 }
 
 void i2c_wait_scl_high(void)
 {
-#if I2C_TIMEOUT <= 0
+#if I2C_SLEEPWAIT && !I2C_NOINTERRUPT
+  __asm__ __volatile__
+    (
+     I2C_PORT_MACROS
+      " ldi     r27, %[HISPIN]          ;load spin counter \n\t"
+      " ldi     r26, %[LOSPIN] \n\t"
+      "_Lwait_spin: \n\t"
+      " i2c_sbic %[SCLIN],%[SCLPIN]      ;skip if SCL still low ;; 1C \n\t"
+#if __AVR_HAVE_JMP_CALL__
+      " jmp     _Lwait_scl_is_high \n\t"
+#else
+      " rjmp    _Lwait_scl_is_high \n\t"
+#endif
+      " sbiw    r26,1                   ;dec spin counter      ;; +2 = 3C \n\t"
+      " brne    _Lwait_spin                                    ;; +2 = 5C \n\t"
+      " push    r18                     ;save all call-clobbered registers \n\t"
+      " push    r19                     ;except r0, r26, r27 \n\t"
+      " push    r20 \n\t"
+      " push    r21 \n\t"
+      " push    r22 \n\t"
+      " push    r23 \n\t"
+      " push    r24 \n\t"
+      " push    r25 \n\t"
+      " push    r30 \n\t"
+      " push    r31 \n\t"
+#if __AVR_HAVE_JMP_CALL__
+      " call    ass_i2c_sleep_scl_high  ;sleep until SCL=H or timeout \n\t"
+#else
+      " rcall   ass_i2c_sleep_scl_high  ;sleep until SCL=H or timeout \n\t"
+#endif
+      " tst     r24                     ;Z=1 means timeout \n\t"
+      " pop     r31 \n\t"
+      " pop     r30 \n\t"
+      " pop     r25 \n\t"
+      " pop     r24 \n\t"
+      " pop     r23 \n\t"
+      " pop     r22 \n\t"
+      " pop     r21 \n\t"
+      " pop     r20 \n\t"
+      " pop     r19 \n\t"
+      " pop     r18 \n\t"
+      " brne    _Lwait_scl_is_high \n\t"
+      " sen                             ;timeout -> set N-bit=1 \n\t"
+      " ret \n\t"
+      "_Lwait_scl_is_high: \n\t"
+      " cln                             ;OK -> clear N-bit \n\t"
+#if I2C_TIMERCLOCK
+#if __AVR_HAVE_JMP_CALL__
+      " jmp     ass_i2c_delay_half      ;SCL high phase starts now \n\t"
+#else
+      " rjmp    ass_i2c_delay_half      ;SCL high phase starts now \n\t"
+#endif
+#endif
+      " ret "
+      : : [SCLIN] "n" (SCL_IN), [SCLPIN] "I" (SCL_PIN),
+    [HISPIN] "M" (I2C_SLEEPWAIT_LOOPS>>8),
+    [LOSPIN] "M" (I2C_SLEEPWAIT_LOOPS&0xFF)
+      : "r26", "r27");
+#elif I2C_TIMEOUT <= 0
   __asm__ __volatile__
-    ("_Li2c_wait_stretch: \n\t"
-     " sbis %[SCLIN],%[SCLPIN]  ;wait for SCL high \n\t"
+    (
+     I2C_PORT_MACROS
+     "_Li2c_wait_stretch: \n\t"
+     " i2c_sbis %[SCLIN],%[SCLPIN]  ;wait for SCL high \n\t"
 #if __AVR_HAVE_JMP_CALL__
      " jmp  _Li2c_wait_stretch \n\t"
 #else
      " rjmp  _Li2c_wait_stretch \n\t"
 #endif
      " cln                              ;signal: no timeout \n\t"
+#if I2C_TIMERCLOCK
+#if __AVR_HAVE_JMP_CALL__
+     " jmp     ass_i2c_delay_half      ;SCL high phase starts now \n\t"
+#else
+     " rjmp    ass_i2c_delay_half      ;SCL high phase starts now \n\t"
+#endif
+#endif
      " ret "
-     : : [SCLIN] "I" (SCL_IN), [SCLPIN] "I" (SCL_PIN));
+     : : [SCLIN] "n" (SCL_IN), [SCLPIN] "I" (SCL_PIN));
 #else
   __asm__ __volatile__
-    ( " ldi     r27, %[HISTRETCH]       ;load delay counter \n\t"
+    (
+     I2C_PORT_MACROS
+      " ldi     r27, %[HISTRETCH]       ;load delay counter \n\t"
       " ldi     r26, %[LOSTRETCH] \n\t"
       "_Lwait_stretch: \n\t"
       " clr     __tmp_reg__             ;do next loop 255 times \n\t"
@@ -316,6 +1026,13 @@ void i2c_wait_scl_high(void)
 #endif
       "_Lstretch_done:                  ;SCL=1 sensed \n\t"
       " cln                             ;OK -> clear N-bit \n\t"
+#if I2C_TIMERCLOCK
+#if __AVR_HAVE_JMP_CALL__
+      " jmp     ass_i2c_delay_half      ;SCL high phase starts now \n\t"
+#else
+      " rjmp    ass_i2c_delay_half      ;SCL high phase starts now \n\t"
+#endif
+#endif
 #if __AVR_HAVE_JMP_CALL__
       " jmp _Lwait_return              ; and return with N=0 \n\t"
 #else
@@ -323,7 +1040,7 @@ void i2c_wait_scl_high(void)
 #endif
       "_Lcheck_scl_level:                                      ;; call = 3C\n\t"
       " cln                                                    ;; +1C = 4C \n\t"
-      " sbic    %[SCLIN],%[SCLPIN]      ;skip if SCL still low ;; +2C = 6C \n\t"
+      " i2c_sbic %[SCLIN],%[SCLPIN]      ;skip if SCL still low ;; +2C = 6C \n\t"
 #if __AVR_HAVE_JMP_CALL__
             " jmp    _Lscl_high                                     ;; +0C = 6C \n\t"
 #else
@@ -335,7 +1052,7 @@ void i2c_wait_scl_high(void)
       " ret                             ;return N-Bit=1 if low ;; +4 = 12C\n\t"
 
       "_Lwait_return:"
-      : : [SCLIN] "I" (SCL_IN), [SCLPIN] "I" (SCL_PIN),
+      : : [SCLIN] "n" (SCL_IN), [SCLPIN] "I" (SCL_PIN),
     [HISTRETCH] "M" (I2C_MAX_STRETCH>>8),
     [LOSTRETCH] "M" (I2C_MAX_STRETCH&0xFF)
       : "r26", "r27");
@@ -343,8 +1060,46 @@ void i2c_wait_scl_high(void)
 }
 #endif // !I2C_HARDWARE
 
+#if I2C_HARDWARE_XT
+// baud rate register value, ignoring the rise time
+#define I2C_TWI_MBAUD ((I2C_CPUFREQ/SCL_CLOCK - 10)/2)
+
+// Internal wait function: wait until one of <flags> is set in MSTATUS.
+// Return: false if arbitration was lost, there was a bus error, or
+// I2C_TIMEOUT msec have passed
+bool i2c_twi_wait(uint8_t flags)
+{
+#if I2C_TIMEOUT
+  uint32_t start = millis();
+#endif
+
+  while (!(TWI0.MSTATUS & flags)) {
+#if I2C_TIMEOUT
+    if (millis() - start > I2C_TIMEOUT) return false;
+#endif
+  }
+  return !(TWI0.MSTATUS & (TWI_ARBLOST_bm | TWI_BUSERR_bm));
+}
+#endif
+
 bool i2c_init(void)
-#if I2C_HARDWARE
+#if I2C_HARDWARE_XT
+{
+#if I2C_PULLUP
+  pinMode(SDA, INPUT_PULLUP);
+  pinMode(SCL, INPUT_PULLUP);
+#endif
+  TWI0.MCTRLA = 0;
+#if I2C_TWI_MBAUD > 255
+  TWI0.MBAUD = 255;
+#else
+  TWI0.MBAUD = I2C_TWI_MBAUD;
+#endif
+  TWI0.MCTRLA = TWI_ENABLE_bm;
+  TWI0.MSTATUS = TWI_BUSSTATE_IDLE_gc;      /* force bus state to idle */
+  return (digitalRead(SDA) != 0 && digitalRead(SCL) != 0);
+}
+#elif I2C_HARDWARE
 {
 #if __has_include("digitalWriteFast.h")
 #include "digitalWriteFast.h"
@@ -376,37 +1131,64 @@ bool i2c_init(void)
 #else
 {
   __asm__ __volatile__
-    (" cbi      %[SDADDR],%[SDAPIN]     ;release SDA \n\t"
-     " cbi      %[SCLDDR],%[SCLPIN]     ;release SCL \n\t"
+    (
+     I2C_PORT_MACROS
+     " i2c_cbi  %[SDADDR],%[SDAPIN]     ;release SDA \n\t"
+     " i2c_cbi  %[SCLDDR],%[SCLPIN]     ;release SCL \n\t"
 #if I2C_PULLUP
-     " sbi      %[SDAOUT],%[SDAPIN]     ;enable SDA pull-up\n\t"
+     " i2c_sbi  %[SDAOUT],%[SDAPIN]     ;enable SDA pull-up\n\t"
 #else
-     " cbi      %[SDAOUT],%[SDAPIN]     ;clear SDA output value \n\t"
+     " i2c_cbi  %[SDAOUT],%[SDAPIN]     ;clear SDA output value \n\t"
 #endif
-#if I2C_PULLUP
-     " sbi      %[SCLOUT],%[SCLPIN]     ;enable SCL pull-up\n\t"
+#if I2C_PULLUP || I2C_SCL_PUSHPULL
+     " i2c_sbi  %[SCLOUT],%[SCLPIN]     ;enable SCL pull-up\n\t"
 #else
-     " cbi      %[SCLOUT],%[SCLPIN]     ;clear SCL output value \n\t"
+     " i2c_cbi  %[SCLOUT],%[SCLPIN]     ;clear SCL output value \n\t"
+#endif
+#if I2C_SCL_PUSHPULL
+     " i2c_sbi  %[SCLDDR],%[SCLPIN]     ;drive SCL high from now on \n\t"
+#endif
+#if I2C_TIMERCLOCK && I2C_TIMER_SETUP
+     " ldi      r24,%[TIMERTOP]         ;timer 2 in CTC mode \n\t"
+     " sts      %[OCRA],r24 \n\t"
+     " ldi      r24,%[TIMERWGM] \n\t"
+     " sts      %[TCCRA],r24 \n\t"
+     " ldi      r24,%[TIMERCS]          ;start timer \n\t"
+     " sts      %[TCCRB],r24 \n\t"
 #endif
      " clr      r24                     ;set return value to false \n\t"
      " clr      r25                     ;set return value to false \n\t"
-     " sbis     %[SDAIN],%[SDAPIN]      ;check for SDA high\n\t"
+     " i2c_sbis %[SDAIN],%[SDAPIN]      ;check for SDA high\n\t"
      " ret                              ;if low return with false \n\t"
-     " sbis     %[SCLIN],%[SCLPIN]      ;check for SCL high \n\t"
+     " i2c_sbis %[SCLIN],%[SCLPIN]      ;check for SCL high \n\t"
      " ret                              ;if low return with false \n\t"
      " ldi      r24,1                   ;set return value to true \n\t"
      " ret "
      : :
-       [SCLDDR] "I"  (SCL_DDR), [SCLPIN] "I" (SCL_PIN),
-       [SCLIN] "I" (SCL_IN), [SCLOUT] "I" (SCL_OUT),
-       [SDADDR] "I"  (SDA_DDR), [SDAPIN] "I" (SDA_PIN),
-       [SDAIN] "I" (SDA_IN), [SDAOUT] "I" (SDA_OUT));
+       [SCLDDR] "n"  (SCL_DDR), [SCLPIN] "I" (SCL_PIN),
+       [SCLIN] "n" (SCL_IN), [SCLOUT] "n" (SCL_OUT),
+       [SDADDR] "n"  (SDA_DDR), [SDAPIN] "I" (SDA_PIN),
+       [SDAIN] "n" (SDA_IN), [SDAOUT] "n" (SDA_OUT)
+#if I2C_TIMERCLOCK && I2C_TIMER_SETUP
+       , [OCRA] "n" (_SFR_MEM_ADDR(OCR2A)), [TCCRA] "n" (_SFR_MEM_ADDR(TCCR2A)),
+       [TCCRB] "n" (_SFR_MEM_ADDR(TCCR2B)), [TIMERTOP] "M" (I2C_TIMER_TOP),
+       [TIMERWGM] "M" (_BV(WGM21)), [TIMERCS] "M" (I2C_TIMER_CS)
+#endif
+       );
   return true;
 }
 #endif
 
 bool  i2c_start(uint8_t addr)
-#if I2C_HARDWARE
+#if I2C_HARDWARE_XT
+{
+  // send START condition and address; for reading, the first byte is
+  // received as well
+  TWI0.MADDR = addr;
+  if (!i2c_twi_wait(TWI_WIF_bm | TWI_RIF_bm)) return false;
+  return !(TWI0.MSTATUS & TWI_RXACK_bm);
+}
+#elif I2C_HARDWARE
 {
   uint8_t   twst;
 #if I2C_TIMEOUT
@@ -448,19 +1230,23 @@ bool  i2c_start(uint8_t addr)
 {
   __asm__ __volatile__
     (
-#if I2C_NOINTERRUPT
+     I2C_PORT_MACROS
+     I2C_SPEED_SELECT
+#if I2C_NOINTERRUPT == 1
      " cli                              ;clear IRQ bit \n\t"
 #endif
-     " sbis     %[SCLIN],%[SCLPIN]      ;check for clock stretching slave\n\t"
+#if !I2C_SCL_PUSHPULL
+     " i2c_sbis %[SCLIN],%[SCLPIN]      ;check for clock stretching slave\n\t"
 #if __AVR_HAVE_JMP_CALL__
             " call    ass_i2c_wait_scl_high   ;wait until SCL=H\n\t"
 #else
             " rcall    ass_i2c_wait_scl_high   ;wait until SCL=H\n\t"
 #endif
+#endif
 #if I2C_PULLUP
-     " cbi      %[SDAOUT],%[SDAPIN]     ;disable pull-up \n\t"
+     " i2c_cbi  %[SDAOUT],%[SDAPIN]     ;disable pull-up \n\t"
 #endif
-     " sbi      %[SDADDR],%[SDAPIN]     ;force SDA low  \n\t"
+     " i2c_sbi  %[SDADDR],%[SDAPIN]     ;force SDA low  \n\t"
 #if __AVR_HAVE_JMP_CALL__
             " call    ass_i2c_delay_half      ;wait T/2 \n\t"
             " call    ass_i2c_write           ;now write address \n\t"
@@ -469,15 +1255,20 @@ bool  i2c_start(uint8_t addr)
             " rcall    ass_i2c_write           ;now write address \n\t"
 #endif
      " ret"
-     : : [SDADDR] "I"  (SDA_DDR), [SDAPIN] "I" (SDA_PIN),
-       [SDAOUT] "I" (SDA_OUT), [SCLOUT] "I" (SCL_OUT),
-       [SCLIN] "I" (SCL_IN),[SCLPIN] "I" (SCL_PIN));
+     : : [SDADDR] "n"  (SDA_DDR), [SDAPIN] "I" (SDA_PIN),
+       [SDAOUT] "n" (SDA_OUT), [SCLOUT] "n" (SCL_OUT),
+       [SCLIN] "n" (SCL_IN),[SCLPIN] "I" (SCL_PIN));
   return true; // we never return here!
 }
 #endif
 
 bool  i2c_rep_start(uint8_t addr)
-#if I2C_HARDWARE
+#if I2C_HARDWARE_XT
+{
+  // writing MADDR while owning the bus sends a repeated start
+  return i2c_start(addr);
+}
+#elif I2C_HARDWARE
 {
   return i2c_start(addr);
 }
@@ -486,46 +1277,61 @@ bool  i2c_rep_start(uint8_t addr)
   __asm__ __volatile__
 
     (
-#if I2C_NOINTERRUPT
+     I2C_PORT_MACROS
+     I2C_SPEED_SELECT
+#if I2C_NOINTERRUPT == 1
      " cli \n\t"
 #endif
-#if I2C_PULLUP
-     " cbi      %[SCLOUT],%[SCLPIN]     ;disable SCL pull-up \n\t"
+#if I2C_PULLUP || I2C_SCL_PUSHPULL
+     " i2c_cbi  %[SCLOUT],%[SCLPIN]     ;disable SCL pull-up \n\t"
+#endif
+#if !I2C_SCL_PUSHPULL
+     " i2c_sbi %[SCLDDR],%[SCLPIN] ;force SCL low \n\t"
 #endif
-     " sbi  %[SCLDDR],%[SCLPIN] ;force SCL low \n\t"
 #if __AVR_HAVE_JMP_CALL__
             " call     ass_i2c_delay_half  ;delay  T/2 \n\t"
 #else
             " rcall     ass_i2c_delay_half  ;delay  T/2 \n\t"
 #endif
-     " cbi  %[SDADDR],%[SDAPIN] ;release SDA \n\t"
+     " i2c_cbi %[SDADDR],%[SDAPIN] ;release SDA \n\t"
 #if I2C_PULLUP
-     " sbi      %[SDAOUT],%[SDAPIN]     ;enable SDA pull-up \n\t"
+     " i2c_sbi  %[SDAOUT],%[SDAPIN]     ;enable SDA pull-up \n\t"
 #endif
 #if __AVR_HAVE_JMP_CALL__
             " call ass_i2c_delay_half  ;delay T/2 \n\t"
 #else
             " rcall ass_i2c_delay_half  ;delay T/2 \n\t"
 #endif
-     " cbi  %[SCLDDR],%[SCLPIN] ;release SCL \n\t"
-#if I2C_PULLUP
-     " sbi      %[SCLOUT],%[SCLPIN] ;enable SCL pull-up \n\t"
+#if I2C_NOINTERRUPT == 2
+     " in       r22,__SREG__            ;save IRQ state \n\t"
+     " cli                              ;SDA and SCL must not be high for long \n\t"
+#endif
+#if !I2C_SCL_PUSHPULL
+     " i2c_cbi %[SCLDDR],%[SCLPIN] ;release SCL \n\t"
+#endif
+#if I2C_PULLUP || I2C_SCL_PUSHPULL
+     " i2c_sbi  %[SCLOUT],%[SCLPIN] ;enable SCL pull-up \n\t"
 #endif
 #if __AVR_HAVE_JMP_CALL__
             " call     ass_i2c_delay_half  ;delay  T/2 \n\t"
 #else
             " rcall     ass_i2c_delay_half  ;delay  T/2 \n\t"
 #endif
-     " sbis     %[SCLIN],%[SCLPIN]      ;check for clock stretching slave\n\t"
+#if !I2C_SCL_PUSHPULL
+     " i2c_sbis %[SCLIN],%[SCLPIN]      ;check for clock stretching slave\n\t"
 #if __AVR_HAVE_JMP_CALL__
             " call    ass_i2c_wait_scl_high   ;wait until SCL=H\n\t"
 #else
             " rcall    ass_i2c_wait_scl_high   ;wait until SCL=H\n\t"
 #endif
+#endif
 #if I2C_PULLUP
-     " cbi  %[SDAOUT],%[SDAPIN] ;disable SDA pull-up\n\t"
+     " i2c_cbi %[SDAOUT],%[SDAPIN] ;disable SDA pull-up\n\t"
+#endif
+     " i2c_sbi %[SDADDR],%[SDAPIN] ;force SDA low \n\t"
+#if I2C_NOINTERRUPT == 2
+     " out      __SREG__,r22            ;restore IRQ state \n\t"
 #endif
-     " sbi  %[SDADDR],%[SDAPIN] ;force SDA low \n\t"
 #if __AVR_HAVE_JMP_CALL__
             " call     ass_i2c_delay_half  ;delay  T/2 \n\t"
             " call    ass_i2c_write       \n\t"
@@ -534,15 +1340,29 @@ bool  i2c_rep_start(uint8_t addr)
             " rcall    ass_i2c_write       \n\t"
 #endif
      " ret"
-     : : [SCLDDR] "I"  (SCL_DDR), [SCLPIN] "I" (SCL_PIN),
-       [SCLIN] "I" (SCL_IN), [SCLOUT] "I" (SCL_OUT), [SDAOUT] "I" (SDA_OUT),
-       [SDADDR] "I"  (SDA_DDR), [SDAPIN] "I" (SDA_PIN));
+     : : [SCLDDR] "n"  (SCL_DDR), [SCLPIN] "I" (SCL_PIN),
+       [SCLIN] "n" (SCL_IN), [SCLOUT] "n" (SCL_OUT), [SDAOUT] "n" (SDA_OUT),
+       [SDADDR] "n"  (SDA_DDR), [SDAPIN] "I" (SDA_PIN));
   return true; // just to fool the compiler
 }
 #endif
 
 bool  i2c_start_wait(uint8_t addr)
-#if I2C_HARDWARE
+#if I2C_HARDWARE_XT
+{
+  uint16_t maxwait = I2C_MAXWAIT;
+
+  while (true) {
+    if (i2c_start(addr)) return true;
+    /* device busy, send stop condition to terminate write operation */
+    i2c_stop();
+    if (maxwait && --maxwait == 0) return false;
+#if I2C_SLEEPWAIT
+    i2c_sleep_idle();
+#endif
+  }
+}
+#elif I2C_HARDWARE
 {
   uint8_t   twst;
   uint16_t maxwait = I2C_MAXWAIT;
@@ -592,6 +1412,9 @@ bool  i2c_start_wait(uint8_t addr)
 
       if (maxwait && --maxwait == 0) return false;
 
+#if I2C_SLEEPWAIT
+      i2c_sleep_idle();
+#endif
       continue;
       }
     //if( twst != TW_MT_SLA_ACK) return 1;
@@ -602,6 +1425,8 @@ bool  i2c_start_wait(uint8_t addr)
 {
  __asm__ __volatile__
    (
+     I2C_PORT_MACROS
+     I2C_SPEED_SELECT
     " push  r24                     ;save original parameter \n\t"
 #if I2C_MAXWAIT
     " ldi     r31, %[HIMAXWAIT]         ;load max wait counter \n\t"
@@ -610,19 +1435,21 @@ bool  i2c_start_wait(uint8_t addr)
     "_Li2c_start_wait1: \n\t"
     " pop       r24                     ;restore original parameter\n\t"
     " push      r24                     ;and save again \n\t"
-#if I2C_NOINTERRUPT
+#if I2C_NOINTERRUPT == 1
     " cli                               ;disable interrupts \n\t"
 #endif
-    " sbis     %[SCLIN],%[SCLPIN]      ;check for clock stretching slave\n\t"
+#if !I2C_SCL_PUSHPULL
+    " i2c_sbis %[SCLIN],%[SCLPIN]      ;check for clock stretching slave\n\t"
 #if __AVR_HAVE_JMP_CALL__
            " call    ass_i2c_wait_scl_high   ;wait until SCL=H\n\t"
 #else
            " rcall    ass_i2c_wait_scl_high   ;wait until SCL=H\n\t"
 #endif
+#endif
 #if I2C_PULLUP
-     " cbi      %[SDAOUT],%[SDAPIN]     ;disable pull-up \n\t"
+     " i2c_cbi  %[SDAOUT],%[SDAPIN]     ;disable pull-up \n\t"
 #endif
-    " sbi   %[SDADDR],%[SDAPIN] ;force SDA low \n\t"
+    " i2c_sbi %[SDADDR],%[SDAPIN] ;force SDA low \n\t"
 #if __AVR_HAVE_JMP_CALL__
            " call  ass_i2c_delay_half  ;delay T/2 \n\t"
            " call  ass_i2c_write           ;write address \n\t"
@@ -641,6 +1468,17 @@ bool  i2c_start_wait(uint8_t addr)
     " sbiw      r30,1                   ;decrement max wait counter\n\t"
     " breq       _Li2c_start_wait_done  ;if zero reached, exit with false -> r24 already zero!\n\t"
 #endif
+#if I2C_SLEEPWAIT
+    " push      r30                     ;save max wait counter \n\t"
+    " push      r31 \n\t"
+#if __AVR_HAVE_JMP_CALL__
+           " call  ass_i2c_sleep_idle      ;sleep until next IRQ \n\t"
+#else
+           " rcall  ass_i2c_sleep_idle      ;sleep until next IRQ \n\t"
+#endif
+    " pop       r31 \n\t"
+    " pop       r30 \n\t"
+#endif
 #if __AVR_HAVE_JMP_CALL__
            " jmp   _Li2c_start_wait1   ;device busy, poll ack again \n\t"
 #else
@@ -650,8 +1488,8 @@ bool  i2c_start_wait(uint8_t addr)
     " clr       r25                     ;clear high byte of return value\n\t"
     " pop       __tmp_reg__             ;pop off orig argument \n\t"
     " ret "
-    : : [SDADDR] "I"  (SDA_DDR), [SDAPIN] "I" (SDA_PIN), [SDAOUT] "I" (SDA_OUT),
-      [SCLIN] "I" (SCL_IN), [SCLPIN] "I" (SCL_PIN),
+    : : [SDADDR] "n"  (SDA_DDR), [SDAPIN] "I" (SDA_PIN), [SDAOUT] "n" (SDA_OUT),
+      [SCLIN] "n" (SCL_IN), [SCLPIN] "I" (SCL_PIN),
       [HIMAXWAIT] "M" (I2C_MAXWAIT>>8),
       [LOMAXWAIT] "M" (I2C_MAXWAIT&0xFF)
     : "r30", "r31" );
@@ -660,7 +1498,22 @@ bool  i2c_start_wait(uint8_t addr)
 #endif
 
 void  i2c_stop(void)
-#if I2C_HARDWARE
+#if I2C_HARDWARE_XT
+{
+#if I2C_TIMEOUT
+  uint32_t start = millis();
+#endif
+  // NAK a byte just read, then send stop condition
+  TWI0.MCTRLB = TWI_ACKACT_NACK_gc | TWI_MCMD_STOP_gc;
+
+  // wait until the bus is released
+  while ((TWI0.MSTATUS & TWI_BUSSTATE_gm) != TWI_BUSSTATE_IDLE_gc) {
+#if I2C_TIMEOUT
+    if (millis() - start > I2C_TIMEOUT) return;
+#endif
+  }
+}
+#elif I2C_HARDWARE
 {
 #if I2C_TIMEOUT
   uint32_t start = millis();
@@ -679,55 +1532,68 @@ void  i2c_stop(void)
 {
   __asm__ __volatile__
     (
-#if I2C_PULLUP
-     " cbi      %[SCLOUT],%[SCLPIN]     ;disable SCL pull-up \n\t"
+     I2C_PORT_MACROS
+#if I2C_PULLUP || I2C_SCL_PUSHPULL
+     " i2c_cbi  %[SCLOUT],%[SCLPIN]     ;disable SCL pull-up \n\t"
+#endif
+#if !I2C_SCL_PUSHPULL
+     " i2c_sbi  %[SCLDDR],%[SCLPIN]     ;force SCL low \n\t"
 #endif
-     " sbi      %[SCLDDR],%[SCLPIN]     ;force SCL low \n\t"
 #if I2C_PULLUP
-     " cbi      %[SDAOUT],%[SDAPIN]     ;disable pull-up \n\t"
+     " i2c_cbi  %[SDAOUT],%[SDAPIN]     ;disable pull-up \n\t"
 #endif
-     " sbi      %[SDADDR],%[SDAPIN]     ;force SDA low \n\t"
+     " i2c_sbi  %[SDADDR],%[SDAPIN]     ;force SDA low \n\t"
 #if __AVR_HAVE_JMP_CALL__
             " call    ass_i2c_delay_half      ;T/2 delay \n\t"
 #else
             " rcall    ass_i2c_delay_half      ;T/2 delay \n\t"
 #endif
-     " cbi      %[SCLDDR],%[SCLPIN]     ;release SCL \n\t"
-#if I2C_PULLUP
-     " sbi      %[SCLOUT],%[SCLPIN] ;enable SCL pull-up \n\t"
+#if !I2C_SCL_PUSHPULL
+     " i2c_cbi  %[SCLDDR],%[SCLPIN]     ;release SCL \n\t"
+#endif
+#if I2C_PULLUP || I2C_SCL_PUSHPULL
+     " i2c_sbi  %[SCLOUT],%[SCLPIN] ;enable SCL pull-up \n\t"
 #endif
 #if __AVR_HAVE_JMP_CALL__
             " call    ass_i2c_delay_half      ;T/2 delay \n\t"
 #else
             " rcall    ass_i2c_delay_half      ;T/2 delay \n\t"
 #endif
-     " sbis     %[SCLIN],%[SCLPIN]      ;check for clock stretching slave\n\t"
+#if !I2C_SCL_PUSHPULL
+     " i2c_sbis %[SCLIN],%[SCLPIN]      ;check for clock stretching slave\n\t"
 #if __AVR_HAVE_JMP_CALL__
             " call    ass_i2c_wait_scl_high   ;wait until SCL=H\n\t"
 #else
             " rcall    ass_i2c_wait_scl_high   ;wait until SCL=H\n\t"
 #endif
-     " cbi      %[SDADDR],%[SDAPIN]     ;release SDA \n\t"
+#endif
+     " i2c_cbi  %[SDADDR],%[SDAPIN]     ;release SDA \n\t"
 #if I2C_PULLUP
-     " sbi      %[SDAOUT],%[SDAPIN]     ;enable SDA pull-up \n\t"
+     " i2c_sbi  %[SDAOUT],%[SDAPIN]     ;enable SDA pull-up \n\t"
 #endif
 #if __AVR_HAVE_JMP_CALL__
             " call    ass_i2c_delay_half \n\t"
 #else
             " rcall    ass_i2c_delay_half \n\t"
 #endif
-#if I2C_NOINTERRUPT
+#if I2C_NOINTERRUPT == 1
      " sei                              ;enable interrupts again!\n\t"
 #endif
-     : : [SCLDDR] "I"  (SCL_DDR), [SCLPIN] "I" (SCL_PIN), [SCLIN] "I" (SCL_IN),
-       [SDAOUT] "I" (SDA_OUT), [SCLOUT] "I" (SCL_OUT),
-       [SDADDR] "I"  (SDA_DDR), [SDAPIN] "I" (SDA_PIN));
+     : : [SCLDDR] "n"  (SCL_DDR), [SCLPIN] "I" (SCL_PIN), [SCLIN] "n" (SCL_IN),
+       [SDAOUT] "n" (SDA_OUT), [SCLOUT] "n" (SCL_OUT),
+       [SDADDR] "n"  (SDA_DDR), [SDAPIN] "I" (SDA_PIN));
 }
 #endif
 
 
 bool i2c_write(uint8_t value)
-#if I2C_HARDWARE
+#if I2C_HARDWARE_XT
+{
+  TWI0.MDATA = value;
+  if (!i2c_twi_wait(TWI_WIF_bm)) return false;
+  return !(TWI0.MSTATUS & TWI_RXACK_bm);
+}
+#elif I2C_HARDWARE
 {
   uint8_t   twst;
 #if I2C_TIMEOUT
@@ -751,44 +1617,194 @@ bool i2c_write(uint8_t value)
   if( twst != TW_MT_DATA_ACK) return false;
   return true;
 }
-#else
+#elif I2C_UNROLL
 {
   __asm__ __volatile__
     (
-     " sec                              ;set carry flag \n\t"
-     " rol      r24                     ;shift in carry and shift out MSB \n\t"
-#if __AVR_HAVE_JMP_CALL__
-            " jmp _Li2c_write_first \n\t"
-#else
-            " rjmp _Li2c_write_first \n\t"
+     I2C_PORT_MACROS
+#if I2C_NOINTERRUPT == 2
+     " in       r22,__SREG__            ;save IRQ state \n\t"
+     " cli                              ;no interrupts while SCL may be high \n\t"
 #endif
-     "_Li2c_write_bit:\n\t"
-     " lsl      r24                     ;left shift into carry ;; 1C\n\t"
-     "_Li2c_write_first:\n\t"
-     " breq     _Li2c_get_ack           ;jump if TXreg is empty;; +1 = 2C \n\t"
+     " lsl      r24                     ;MSB into carry \n\t"
+     ".irp i2c_bit,7,6,5,4,3,2,1,0      ;unrolled bit loop \n\t"
+#if I2C_PULLUP || I2C_SCL_PUSHPULL
+     " i2c_cbi  %[SCLOUT],%[SCLPIN]     ;disable SCL pull-up \n\t"
+#endif
+#if !I2C_SCL_PUSHPULL
+     " i2c_sbi  %[SCLDDR],%[SCLPIN]     ;force SCL low         ;; 2C \n\t"
+#endif
+     " brcc     1f                                             ;; 3/4C \n\t"
+     " i2c_cbi  %[SDADDR],%[SDAPIN]     ;release SDA           ;; 5C \n\t"
 #if I2C_PULLUP
-     " cbi      %[SCLOUT],%[SCLPIN]     ;disable SCL pull-up \n\t"
+     " i2c_sbi  %[SDAOUT],%[SDAPIN]     ;enable SDA pull-up \n\t"
 #endif
-     " sbi      %[SCLDDR],%[SCLPIN]     ;force SCL low         ;; +2 = 4C \n\t"
-     " nop \n\t"
-     " nop \n\t"
-     " nop \n\t"
-     " brcc     _Li2c_write_low                                ;;+1/+2=5/6C\n\t"
-     " nop                                                     ;; +1 = 7C \n\t"
-     " cbi %[SDADDR],%[SDAPIN]          ;release SDA           ;; +2 = 9C \n\t"
+     " rjmp     2f                                             ;; 7C \n\t"
+     "1: \n\t"
 #if I2C_PULLUP
-     " sbi      %[SDAOUT],%[SDAPIN]     ;enable SDA pull-up \n\t"
+     " i2c_cbi  %[SDAOUT],%[SDAPIN]     ;disable pull-up \n\t"
+#endif
+     " i2c_sbi  %[SDADDR],%[SDAPIN]     ;force SDA low         ;; 6C \n\t"
+     " nop                                                     ;; 7C \n\t"
+     "2: \n\t"
+     I2C_INLINE_DELAY                                          // 7C+X
+#if !I2C_SCL_PUSHPULL
+     " i2c_cbi  %[SCLDDR],%[SCLPIN]     ;release SCL           ;; 9C+X \n\t"
+#endif
+#if I2C_PULLUP || I2C_SCL_PUSHPULL
+     " i2c_sbi  %[SCLOUT],%[SCLPIN]     ;enable SCL pull-up \n\t"
 #endif
+#if I2C_STRETCH_CHECK
+#if I2C_STRETCH_CHECK == 1
+     ".if \\i2c_bit == 7                 ;slaves stretch before the first bit only \n\t"
+#endif
+     " i2c_sbic %[SCLIN],%[SCLPIN]      ;SCL high -> no stretching \n\t"
+     " rjmp     3f                                             ;; 12C+X \n\t"
 #if __AVR_HAVE_JMP_CALL__
-            " jmp      _Li2c_write_high                              ;; +2 = 11C \n\t"
+     " call     ass_i2c_wait_scl_high \n\t"
 #else
-            " rjmp      _Li2c_write_high                              ;; +2 = 11C \n\t"
+     " rcall    ass_i2c_wait_scl_high \n\t"
 #endif
-     "_Li2c_write_low: \n\t"
+     " brpl     3f \n\t"
+#if __AVR_HAVE_JMP_CALL__
+     " jmp      _Li2c_write_return_false ;timeout \n\t"
+#else
+     " rjmp     _Li2c_write_return_false ;timeout \n\t"
+#endif
+     "3: \n\t"
+#if I2C_STRETCH_CHECK == 1
+     ".endif \n\t"
+#endif
+#endif
+     " lsl      r24                     ;next bit into carry   ;; 13C+X \n\t"
+     I2C_INLINE_DELAY                                          // 13C+2X
+     ".endr                             ;; 13C+2X for one bit (10C+2X if not checked) \n\t"
+#if I2C_PULLUP || I2C_SCL_PUSHPULL
+     " i2c_cbi  %[SCLOUT],%[SCLPIN]     ;disable SCL pull-up \n\t"
+#endif
+#if !I2C_SCL_PUSHPULL
+     " i2c_sbi  %[SCLDDR],%[SCLPIN]     ;force SCL low \n\t"
+#endif
+     " nop \n\t"
+     " nop \n\t"
+     " i2c_cbi  %[SDADDR],%[SDAPIN]     ;release SDA \n\t"
+#if I2C_PULLUP
+     " i2c_sbi  %[SDAOUT],%[SDAPIN]     ;enable SDA pull-up \n\t"
+#endif
+     I2C_INLINE_DELAY
+     " clr      r24                     ;return 0 \n\t"
+#if !I2C_SCL_PUSHPULL
+     " i2c_cbi  %[SCLDDR],%[SCLPIN]     ;release SCL \n\t"
+#endif
+#if I2C_PULLUP || I2C_SCL_PUSHPULL
+     " i2c_sbi  %[SCLOUT],%[SCLPIN]     ;enable SCL pull-up \n\t"
+#endif
+#if I2C_STRETCH_CHECK
+     " cln                              ;clear N-bit \n\t"
+     " nop \n\t"
+     " i2c_sbis %[SCLIN],%[SCLPIN]      ;wait SCL high \n\t"
+#if __AVR_HAVE_JMP_CALL__
+     " call     ass_i2c_wait_scl_high \n\t"
+#else
+     " rcall    ass_i2c_wait_scl_high \n\t"
+#endif
+     " brmi     _Li2c_write_return \n\t"
+#endif
+#if I2C_MAJORITY
+     " clr      r20                     ;count SDA low samples \n\t"
+     " i2c_sbis %[SDAIN],%[SDAPIN]      ;1st sample \n\t"
+     " inc      r20 \n\t"
+     I2C_INLINE_DELAY
+     " i2c_sbis %[SDAIN],%[SDAPIN]      ;2nd sample \n\t"
+     " inc      r20 \n\t"
+     " nop \n\t"
+     " nop \n\t"
+     " i2c_sbis %[SDAIN],%[SDAPIN]      ;3rd sample \n\t"
+     " inc      r20 \n\t"
+     " sbrc     r20,1                   ;less than 2 low -> return 0 \n\t"
+     " ldi      r24,1                   ;return true \n\t"
+#else
+     " i2c_sbis %[SDAIN],%[SDAPIN]      ;if SDA hi -> return 0 \n\t"
+     " ldi      r24,1                   ;return true \n\t"
+     I2C_INLINE_DELAY
+#endif
+     "_Li2c_write_return: \n\t"
+     " nop \n\t"
+     " nop \n\t"
+#if I2C_PULLUP || I2C_SCL_PUSHPULL
+     " i2c_cbi  %[SCLOUT],%[SCLPIN]     ;disable SCL pull-up \n\t"
+#endif
+#if !I2C_SCL_PUSHPULL
+     " i2c_sbi  %[SCLDDR],%[SCLPIN]     ;force SCL low so SCL=H is short \n\t"
+#endif
+#if I2C_NOINTERRUPT == 2
+     " out      __SREG__,r22            ;restore IRQ state \n\t"
+#endif
+     " ret \n\t"
+#if I2C_STRETCH_CHECK
+     "_Li2c_write_return_false: \n\t"
+     " clr      r24                     ;return false because of timeout \n\t"
+#if __AVR_HAVE_JMP_CALL__
+     " jmp      _Li2c_write_return \n\t"
+#else
+     " rjmp     _Li2c_write_return \n\t"
+#endif
+#endif
+     ::
+      [SCLDDR] "n"  (SCL_DDR), [SCLPIN] "I" (SCL_PIN), [SCLIN] "n" (SCL_IN),
+      [SDAOUT] "n" (SDA_OUT), [SCLOUT] "n" (SCL_OUT),
+      [SDADDR] "n"  (SDA_DDR), [SDAPIN] "I" (SDA_PIN), [SDAIN] "n" (SDA_IN),
+      [DELAY] "n" (I2C_UNROLL_DELAY), [PAD] "n" (I2C_UNROLL_PAD));
+  return true; // fooling the compiler
+}
+#else
+{
+  __asm__ __volatile__
+    (
+     I2C_PORT_MACROS
+#if I2C_NOINTERRUPT == 2
+     " in       r22,__SREG__            ;save IRQ state \n\t"
+     " cli                              ;no interrupts while SCL may be high \n\t"
+#endif
+#if I2C_STRETCH_CHECK == 1
+     " set                              ;T=1: first bit \n\t"
+#endif
+     " sec                              ;set carry flag \n\t"
+     " rol      r24                     ;shift in carry and shift out MSB \n\t"
+#if __AVR_HAVE_JMP_CALL__
+            " jmp _Li2c_write_first \n\t"
+#else
+            " rjmp _Li2c_write_first \n\t"
+#endif
+     "_Li2c_write_bit:\n\t"
+     " lsl      r24                     ;left shift into carry ;; 1C\n\t"
+     "_Li2c_write_first:\n\t"
+     " breq     _Li2c_get_ack           ;jump if TXreg is empty;; +1 = 2C \n\t"
+#if I2C_PULLUP || I2C_SCL_PUSHPULL
+     " i2c_cbi  %[SCLOUT],%[SCLPIN]     ;disable SCL pull-up \n\t"
+#endif
+#if !I2C_SCL_PUSHPULL
+     " i2c_sbi  %[SCLDDR],%[SCLPIN]     ;force SCL low         ;; +2 = 4C \n\t"
+#endif
+     " nop \n\t"
+     " nop \n\t"
+     " nop \n\t"
+     " brcc     _Li2c_write_low                                ;;+1/+2=5/6C\n\t"
+     " nop                                                     ;; +1 = 7C \n\t"
+     " i2c_cbi %[SDADDR],%[SDAPIN]          ;release SDA           ;; +2 = 9C \n\t"
+#if I2C_PULLUP
+     " i2c_sbi  %[SDAOUT],%[SDAPIN]     ;enable SDA pull-up \n\t"
+#endif
+#if __AVR_HAVE_JMP_CALL__
+            " jmp      _Li2c_write_high                              ;; +2 = 11C \n\t"
+#else
+            " rjmp      _Li2c_write_high                              ;; +2 = 11C \n\t"
+#endif
+     "_Li2c_write_low: \n\t"
 #if I2C_PULLUP
-     " cbi      %[SDAOUT],%[SDAPIN]     ;disable pull-up \n\t"
+     " i2c_cbi  %[SDAOUT],%[SDAPIN]     ;disable pull-up \n\t"
 #endif
-     " sbi  %[SDADDR],%[SDAPIN] ;force SDA low         ;; +2 = 9C \n\t"
+     " i2c_sbi %[SDADDR],%[SDAPIN] ;force SDA low         ;; +2 = 9C \n\t"
 #if __AVR_HAVE_JMP_CALL__
             " jmp  _Li2c_write_high                               ;;+2 = 11C \n\t"
 #else
@@ -802,21 +1818,35 @@ bool i2c_write(uint8_t value)
             " rcall     ass_i2c_delay_half  ;delay T/2             ;;+X = 11C+X\n\t"
 #endif
 #endif
-     " cbi  %[SCLDDR],%[SCLPIN] ;release SCL           ;;+2 = 13C+X\n\t"
-#if I2C_PULLUP
-     " sbi      %[SCLOUT],%[SCLPIN] ;enable SCL pull-up \n\t"
+#if !I2C_SCL_PUSHPULL
+     " i2c_cbi %[SCLDDR],%[SCLPIN] ;release SCL           ;;+2 = 13C+X\n\t"
+#endif
+#if I2C_PULLUP || I2C_SCL_PUSHPULL
+     " i2c_sbi  %[SCLOUT],%[SCLPIN] ;enable SCL pull-up \n\t"
+#endif
+#if !I2C_STRETCH_CHECK
+#if __AVR_HAVE_JMP_CALL__
+            " jmp      _Ldelay_scl_high      ;no check for stretching \n\t"
+#else
+            " rjmp      _Ldelay_scl_high      ;no check for stretching \n\t"
+#endif
+#else
+#if I2C_STRETCH_CHECK == 1
+     " brtc     _Ldelay_scl_high        ;only the first bit is checked \n\t"
+     " clt \n\t"
 #endif
      " cln                              ;clear N-bit           ;;+1 = 14C+X\n\t"
      " nop \n\t"
      " nop \n\t"
      " nop \n\t"
-     " sbis %[SCLIN],%[SCLPIN]  ;check for SCL high    ;;+2 = 16C+X\n\t"
+     " i2c_sbis %[SCLIN],%[SCLPIN]  ;check for SCL high    ;;+2 = 16C+X\n\t"
 #if __AVR_HAVE_JMP_CALL__
             " call    ass_i2c_wait_scl_high \n\t"
 #else
             " rcall    ass_i2c_wait_scl_high \n\t"
 #endif
      " brpl     _Ldelay_scl_high                              ;;+2 = 18C+X\n\t"
+#endif
      "_Li2c_write_return_false: \n\t"
      " clr      r24                     ; return false because of timeout \n\t"
 #if __AVR_HAVE_JMP_CALL__
@@ -839,15 +1869,17 @@ bool i2c_write(uint8_t value)
 #endif
      "              ;; +2 = 20C +2X for one bit-loop \n\t"
      "_Li2c_get_ack: \n\t"
-#if I2C_PULLUP
-     " cbi      %[SCLOUT],%[SCLPIN]     ;disable SCL pull-up \n\t"
+#if I2C_PULLUP || I2C_SCL_PUSHPULL
+     " i2c_cbi  %[SCLOUT],%[SCLPIN]     ;disable SCL pull-up \n\t"
+#endif
+#if !I2C_SCL_PUSHPULL
+     " i2c_sbi %[SCLDDR],%[SCLPIN] ;force SCL low ;; +2 = 5C \n\t"
 #endif
-     " sbi  %[SCLDDR],%[SCLPIN] ;force SCL low ;; +2 = 5C \n\t"
      " nop \n\t"
      " nop \n\t"
-     " cbi  %[SDADDR],%[SDAPIN] ;release SDA ;;+2 = 7C \n\t"
+     " i2c_cbi %[SDADDR],%[SDAPIN] ;release SDA ;;+2 = 7C \n\t"
 #if I2C_PULLUP
-     " sbi      %[SDAOUT],%[SDAPIN]     ;enable SDA pull-up \n\t"
+     " i2c_sbi  %[SDAOUT],%[SDAPIN]     ;enable SDA pull-up \n\t"
 #endif
 #if I2C_DELAY_COUNTER >= 1
 #if __AVR_HAVE_JMP_CALL__
@@ -858,21 +1890,45 @@ bool i2c_write(uint8_t value)
 #endif
      " clr  r25                                            ;; 17C+2X \n\t"
      " clr  r24             ;return 0              ;; 14C + X \n\t"
-     " cbi  %[SCLDDR],%[SCLPIN] ;release SCL ;; +2 = 9C+X\n\t"
-#if I2C_PULLUP
-     " sbi      %[SCLOUT],%[SCLPIN] ;enable SCL pull-up \n\t"
+#if !I2C_SCL_PUSHPULL
+     " i2c_cbi %[SCLDDR],%[SCLPIN] ;release SCL ;; +2 = 9C+X\n\t"
 #endif
+#if I2C_PULLUP || I2C_SCL_PUSHPULL
+     " i2c_sbi  %[SCLOUT],%[SCLPIN] ;enable SCL pull-up \n\t"
+#endif
+#if I2C_STRETCH_CHECK
      "_Li2c_ack_wait: \n\t"
      " cln                              ; clear N-bit          ;; 10C + X\n\t"
      " nop \n\t"
-     " sbis %[SCLIN],%[SCLPIN]  ;wait SCL high         ;; 12C + X \n\t"
+     " i2c_sbis %[SCLIN],%[SCLPIN]  ;wait SCL high         ;; 12C + X \n\t"
 #if __AVR_HAVE_JMP_CALL__
             " call    ass_i2c_wait_scl_high \n\t"
 #else
             " rcall    ass_i2c_wait_scl_high \n\t"
 #endif
      " brmi     _Li2c_write_return_false                       ;; 13C + X \n\t "
-     " sbis %[SDAIN],%[SDAPIN]      ;if SDA hi -> return 0 ;; 15C + X \n\t"
+#endif
+#if I2C_MAJORITY
+     " clr  r20             ;count SDA low samples \n\t"
+     " i2c_sbis %[SDAIN],%[SDAPIN]      ;1st sample \n\t"
+     " inc  r20 \n\t"
+#if I2C_DELAY_COUNTER >= 1
+#if __AVR_HAVE_JMP_CALL__
+            " call ass_i2c_delay_half  ;delay T/2 \n\t"
+#else
+            " rcall ass_i2c_delay_half  ;delay T/2 \n\t"
+#endif
+#endif
+     " i2c_sbis %[SDAIN],%[SDAPIN]      ;2nd sample \n\t"
+     " inc  r20 \n\t"
+     " nop \n\t"
+     " nop \n\t"
+     " i2c_sbis %[SDAIN],%[SDAPIN]      ;3rd sample \n\t"
+     " inc  r20 \n\t"
+     " sbrc r20,1           ;less than 2 low -> return 0 \n\t"
+     " ldi  r24,1           ;return true           ;; 25C + 2X \n\t"
+#else
+     " i2c_sbis %[SDAIN],%[SDAPIN]      ;if SDA hi -> return 0 ;; 15C + X \n\t"
      " ldi  r24,1                   ;return true           ;; 16C + X \n\t"
 #if I2C_DELAY_COUNTER >= 1
 #if __AVR_HAVE_JMP_CALL__
@@ -880,26 +1936,44 @@ bool i2c_write(uint8_t value)
 #else
             " rcall ass_i2c_delay_half  ;delay T/2             ;; 16C + 2X \n\t"
 #endif
+#endif
 #endif
      "_Li2c_write_return: \n\t"
      " nop \n\t "
      " nop \n\t "
-#if I2C_PULLUP
-     " cbi      %[SCLOUT],%[SCLPIN]     ;disable SCL pull-up \n\t"
+#if I2C_PULLUP || I2C_SCL_PUSHPULL
+     " i2c_cbi  %[SCLOUT],%[SCLPIN]     ;disable SCL pull-up \n\t"
+#endif
+#if !I2C_SCL_PUSHPULL
+     " i2c_sbi %[SCLDDR],%[SCLPIN] ;force SCL low so SCL=H is short\n\t"
+#endif
+#if I2C_NOINTERRUPT == 2
+     " out      __SREG__,r22            ;restore IRQ state \n\t"
 #endif
-     " sbi  %[SCLDDR],%[SCLPIN] ;force SCL low so SCL=H is short\n\t"
      " ret \n\t"
      "              ;; + 4 = 17C + 2X for acknowldge bit"
      ::
-      [SCLDDR] "I"  (SCL_DDR), [SCLPIN] "I" (SCL_PIN), [SCLIN] "I" (SCL_IN),
-      [SDAOUT] "I" (SDA_OUT), [SCLOUT] "I" (SCL_OUT),
-      [SDADDR] "I"  (SDA_DDR), [SDAPIN] "I" (SDA_PIN), [SDAIN] "I" (SDA_IN));
+      [SCLDDR] "n"  (SCL_DDR), [SCLPIN] "I" (SCL_PIN), [SCLIN] "n" (SCL_IN),
+      [SDAOUT] "n" (SDA_OUT), [SCLOUT] "n" (SCL_OUT),
+      [SDADDR] "n"  (SDA_DDR), [SDAPIN] "I" (SDA_PIN), [SDAIN] "n" (SDA_IN));
   return true; // fooling the compiler
 }
 #endif
 
 uint8_t i2c_read(bool last)
-#if I2C_HARDWARE
+#if I2C_HARDWARE_XT
+{
+  uint8_t data;
+
+  if (!i2c_twi_wait(TWI_RIF_bm)) return 0xFF;
+  data = TWI0.MDATA;
+  if (last)
+    TWI0.MCTRLB = TWI_ACKACT_NACK_gc; // sent with the next stop or repeated start
+  else
+    TWI0.MCTRLB = TWI_ACKACT_ACK_gc | TWI_MCMD_RECVTRANS_gc;
+  return data;
+}
+#elif I2C_HARDWARE
 {
 #if I2C_TIMEOUT
   uint32_t start = millis();
@@ -913,19 +1987,169 @@ uint8_t i2c_read(bool last)
   }
   return TWDR;
 }
+#elif I2C_UNROLL
+{
+  __asm__ __volatile__
+    (
+     I2C_PORT_MACROS
+#if I2C_NOINTERRUPT == 2
+     " in       r22,__SREG__            ;save IRQ state \n\t"
+     " cli                              ;no interrupts while SCL may be high \n\t"
+#endif
+     " i2c_cbi  %[SDADDR],%[SDAPIN]     ;release SDA (prev. ACK) \n\t"
+#if I2C_PULLUP
+     " i2c_sbi  %[SDAOUT],%[SDAPIN]     ;enable SDA pull-up \n\t"
+#endif
+     ".irp i2c_bit,7,6,5,4,3,2,1,0      ;unrolled bit loop \n\t"
+#if I2C_PULLUP || I2C_SCL_PUSHPULL
+     " i2c_cbi  %[SCLOUT],%[SCLPIN]     ;disable SCL pull-up \n\t"
+#endif
+#if !I2C_SCL_PUSHPULL
+     " i2c_sbi  %[SCLDDR],%[SCLPIN]     ;force SCL low         ;; 2C \n\t"
+#endif
+     " lsl      r23                     ;make room for the bit ;; 3C \n\t"
+#if I2C_LOWCLOCK
+     " nop                              ;give the slave time to change SDA \n\t"
+     " nop \n\t"
+#endif
+     I2C_INLINE_DELAY                                          // 3C+X
+#if !I2C_SCL_PUSHPULL
+     " i2c_cbi  %[SCLDDR],%[SCLPIN]     ;release SCL           ;; 5C+X \n\t"
+#endif
+#if I2C_PULLUP || I2C_SCL_PUSHPULL
+     " i2c_sbi  %[SCLOUT],%[SCLPIN]     ;enable SCL pull-up \n\t"
+#endif
+#if I2C_LOWCLOCK
+     " nop \n\t"
+#endif
+#if !I2C_MAJORITY
+     I2C_INLINE_DELAY                                          // 5C+2X
+#endif
+#if I2C_STRETCH_CHECK
+#if I2C_STRETCH_CHECK == 1
+     ".if \\i2c_bit == 7                 ;slaves stretch before the first bit only \n\t"
+#endif
+     " i2c_sbic %[SCLIN],%[SCLPIN]      ;SCL high -> no stretching \n\t"
+     " rjmp     3f                                             ;; 8C+2X \n\t"
+#if __AVR_HAVE_JMP_CALL__
+     " call     ass_i2c_wait_scl_high \n\t"
+#else
+     " rcall    ass_i2c_wait_scl_high \n\t"
+#endif
+     " brpl     3f \n\t"
+#if __AVR_HAVE_JMP_CALL__
+     " jmp      _Li2c_read_return ;timeout \n\t"
+#else
+     " rjmp     _Li2c_read_return ;timeout \n\t"
+#endif
+     "3: \n\t"
+#if I2C_STRETCH_CHECK == 1
+     ".endif \n\t"
+#endif
+#endif
+#if I2C_MAJORITY
+     " clr      r20                     ;count SDA low samples \n\t"
+     " i2c_sbis %[SDAIN],%[SDAPIN]      ;1st sample \n\t"
+     " inc      r20 \n\t"
+     I2C_INLINE_DELAY
+     " i2c_sbis %[SDAIN],%[SDAPIN]      ;2nd sample \n\t"
+     " inc      r20 \n\t"
+     " nop \n\t"
+     " nop \n\t"
+     " i2c_sbis %[SDAIN],%[SDAPIN]      ;3rd sample \n\t"
+     " inc      r20 \n\t"
+     " cpi      r20,2                   ;C=1 if less than 2 low \n\t"
+     " adc      r23,__zero_reg__        ;store bit             ;; 19C+2X \n\t"
+     ".endr                             ;; 19C+2X for one bit \n\t"
+#else
+     " i2c_sbic %[SDAIN],%[SDAPIN]      ;if SDA is high        ;; 9C+2X \n\t"
+     " ori      r23,0x01                ;store bit             ;; 10C+2X \n\t"
+     ".endr                             ;; 10C+2X for one bit \n\t"
+#endif
+#if I2C_PULLUP || I2C_SCL_PUSHPULL
+     " i2c_cbi  %[SCLOUT],%[SCLPIN]     ;disable SCL pull-up \n\t"
+#endif
+#if !I2C_SCL_PUSHPULL
+     " i2c_sbi  %[SCLDDR],%[SCLPIN]     ;force SCL low \n\t"
+#endif
+     " cpi      r24,0 \n\t"
+     " breq     1f                      ;if (ack=0) \n\t"
+     " i2c_cbi  %[SDADDR],%[SDAPIN]     ;release SDA \n\t"
+#if I2C_PULLUP
+     " i2c_sbi  %[SDAOUT],%[SDAPIN]     ;enable SDA pull-up \n\t"
+#endif
+     " rjmp     2f \n\t"
+     "1:                                ;else \n\t"
+#if I2C_PULLUP
+     " i2c_cbi  %[SDAOUT],%[SDAPIN]     ;disable pull-up \n\t"
+#endif
+     " i2c_sbi  %[SDADDR],%[SDAPIN]     ;force SDA low \n\t"
+     "2: \n\t"
+     " nop \n\t"
+     I2C_INLINE_DELAY
+#if !I2C_SCL_PUSHPULL
+     " i2c_cbi  %[SCLDDR],%[SCLPIN]     ;release SCL \n\t"
+#endif
+#if I2C_PULLUP || I2C_SCL_PUSHPULL
+     " i2c_sbi  %[SCLOUT],%[SCLPIN]     ;enable SCL pull-up \n\t"
+#endif
+#if I2C_STRETCH_CHECK
+     " cln                              ;clear N \n\t"
+     " nop \n\t"
+     " i2c_sbis %[SCLIN],%[SCLPIN]      ;wait SCL high \n\t"
+#if __AVR_HAVE_JMP_CALL__
+     " call     ass_i2c_wait_scl_high \n\t"
+#else
+     " rcall    ass_i2c_wait_scl_high \n\t"
+#endif
+#endif
+     I2C_INLINE_DELAY
+     "_Li2c_read_return: \n\t"
+     " nop \n\t"
+     " nop \n\t"
+#if I2C_PULLUP || I2C_SCL_PUSHPULL
+     " i2c_cbi  %[SCLOUT],%[SCLPIN]     ;disable SCL pull-up \n\t"
+#endif
+#if !I2C_SCL_PUSHPULL
+     " i2c_sbi  %[SCLDDR],%[SCLPIN]     ;force SCL low so SCL=H is short \n\t"
+#endif
+     " mov      r24,r23 \n\t"
+     " clr      r25 \n\t"
+#if I2C_NOINTERRUPT == 2
+     " out      __SREG__,r22            ;restore IRQ state \n\t"
+#endif
+     " ret"
+     ::
+      [SCLDDR] "n"  (SCL_DDR), [SCLPIN] "I" (SCL_PIN), [SCLIN] "n" (SCL_IN),
+      [SDAOUT] "n" (SDA_OUT), [SCLOUT] "n" (SCL_OUT),
+      [SDADDR] "n"  (SDA_DDR), [SDAPIN] "I" (SDA_PIN), [SDAIN] "n" (SDA_IN),
+      [DELAY] "n" (I2C_UNROLL_DELAY), [PAD] "n" (I2C_UNROLL_PAD)
+     );
+  return ' '; // fool the compiler!
+}
 #else
 {
   __asm__ __volatile__
     (
+     I2C_PORT_MACROS
+#if I2C_NOINTERRUPT == 2
+     " in       r22,__SREG__            ;save IRQ state \n\t"
+     " cli                              ;no interrupts while SCL may be high \n\t"
+#endif
+#if I2C_STRETCH_CHECK == 1
+     " set                              ;T=1: first bit \n\t"
+#endif
      " ldi  r23,0x01 \n\t"
      "_Li2c_read_bit: \n\t"
-#if I2C_PULLUP
-     " cbi      %[SCLOUT],%[SCLPIN]     ;disable SCL pull-up \n\t"
+#if I2C_PULLUP || I2C_SCL_PUSHPULL
+     " i2c_cbi  %[SCLOUT],%[SCLPIN]     ;disable SCL pull-up \n\t"
+#endif
+#if !I2C_SCL_PUSHPULL
+     " i2c_sbi %[SCLDDR],%[SCLPIN] ;force SCL low         ;; 2C \n\t"
 #endif
-     " sbi  %[SCLDDR],%[SCLPIN] ;force SCL low         ;; 2C \n\t"
-     " cbi  %[SDADDR],%[SDAPIN] ;release SDA(prev. ACK);; 4C \n\t"
+     " i2c_cbi %[SDADDR],%[SDAPIN] ;release SDA(prev. ACK);; 4C \n\t"
 #if I2C_PULLUP
-     " sbi      %[SDAOUT],%[SDAPIN]     ;enable SDA pull-up \n\t"
+     " i2c_sbi  %[SDAOUT],%[SDAPIN]     ;enable SDA pull-up \n\t"
 #endif
      " nop \n\t"
      " nop \n\t"
@@ -937,45 +2161,81 @@ uint8_t i2c_read(bool last)
             " rcall ass_i2c_delay_half  ;delay T/2             ;; 4C+X \n\t"
 #endif
 #endif
-     " cbi  %[SCLDDR],%[SCLPIN] ;release SCL           ;; 6C + X \n\t"
-#if I2C_PULLUP
-     " sbi      %[SCLOUT],%[SCLPIN] ;enable SCL pull-up \n\t"
+#if !I2C_SCL_PUSHPULL
+     " i2c_cbi %[SCLDDR],%[SCLPIN] ;release SCL           ;; 6C + X \n\t"
 #endif
-#if I2C_DELAY_COUNTER >= 1
+#if I2C_PULLUP || I2C_SCL_PUSHPULL
+     " i2c_sbi  %[SCLOUT],%[SCLPIN] ;enable SCL pull-up \n\t"
+#endif
+#if I2C_DELAY_COUNTER >= 1 && !I2C_MAJORITY
 #if __AVR_HAVE_JMP_CALL__
             " call ass_i2c_delay_half  ;delay T/2             ;; 6C + 2X \n\t"
 #else
             " rcall ass_i2c_delay_half  ;delay T/2             ;; 6C + 2X \n\t"
 #endif
+#endif
+#if I2C_STRETCH_CHECK
+#if I2C_STRETCH_CHECK == 1
+     " brtc     _Li2c_read_sample       ;only the first bit is checked \n\t"
+     " clt \n\t"
 #endif
      " cln                              ; clear N-bit          ;; 7C + 2X \n\t"
      " nop \n\t "
      " nop \n\t "
      " nop \n\t "
-     " sbis     %[SCLIN], %[SCLPIN]     ;check for SCL high    ;; 9C +2X \n\t"
+     " i2c_sbis %[SCLIN], %[SCLPIN]     ;check for SCL high    ;; 9C +2X \n\t"
 #if __AVR_HAVE_JMP_CALL__
             " call    ass_i2c_wait_scl_high \n\t"
 #else
             " rcall    ass_i2c_wait_scl_high \n\t"
 #endif
      " brmi     _Li2c_read_return       ;return if timeout     ;; 10C + 2X\n\t"
+#endif
+#if I2C_STRETCH_CHECK == 1
+     "_Li2c_read_sample: \n\t"
+#endif
+#if I2C_MAJORITY
+     " clr  r20             ;count SDA low samples \n\t"
+     " i2c_sbis %[SDAIN],%[SDAPIN]  ;1st sample \n\t"
+     " inc  r20 \n\t"
+#if I2C_DELAY_COUNTER >= 1
+#if __AVR_HAVE_JMP_CALL__
+            " call ass_i2c_delay_half  ;delay T/2 \n\t"
+#else
+            " rcall ass_i2c_delay_half  ;delay T/2 \n\t"
+#endif
+#endif
+     " i2c_sbis %[SDAIN],%[SDAPIN]  ;2nd sample \n\t"
+     " inc  r20 \n\t"
+     " nop \n\t"
+     " nop \n\t"
+     " i2c_sbis %[SDAIN],%[SDAPIN]  ;3rd sample \n\t"
+     " inc  r20 \n\t"
+     " cpi  r20,2           ;C=1 if less than 2 low ;; 19C + 2X\n\t"
+     " rol  r23             ;store bit             ;; 20C + 2X\n\t"
+     " brcc _Li2c_read_bit          ;while receiv reg not full \n\t"
+     "                         ;; 22C + 2X for one bit loop \n\t"
+#else
      " clc                  ;clear carry flag      ;; 11C + 2X\n\t"
-     " sbic %[SDAIN],%[SDAPIN]  ;if SDA is high        ;; 11C + 2X\n\t"
+     " i2c_sbic %[SDAIN],%[SDAPIN]  ;if SDA is high        ;; 11C + 2X\n\t"
      " sec                  ;set carry flag        ;; 12C + 2X\n\t"
      " rol  r23             ;store bit             ;; 13C + 2X\n\t"
      " brcc _Li2c_read_bit          ;while receiv reg not full \n\t"
      "                         ;; 15C + 2X for one bit loop \n\t"
+#endif
 
      "_Li2c_put_ack: \n\t"
-#if I2C_PULLUP
-     " cbi      %[SCLOUT],%[SCLPIN]     ;disable SCL pull-up \n\t"
+#if I2C_PULLUP || I2C_SCL_PUSHPULL
+     " i2c_cbi  %[SCLOUT],%[SCLPIN]     ;disable SCL pull-up \n\t"
+#endif
+#if !I2C_SCL_PUSHPULL
+     " i2c_sbi %[SCLDDR],%[SCLPIN] ;force SCL low         ;; 2C \n\t"
 #endif
-     " sbi  %[SCLDDR],%[SCLPIN] ;force SCL low         ;; 2C \n\t"
      " cpi  r24,0                                          ;; 3C \n\t"
      " breq _Li2c_put_ack_low   ;if (ack=0) ;; 5C \n\t"
-     " cbi  %[SDADDR],%[SDAPIN] ;release SDA \n\t"
+     " i2c_cbi %[SDADDR],%[SDAPIN] ;release SDA \n\t"
 #if I2C_PULLUP
-     " sbi      %[SDAOUT],%[SDAPIN]     ;enable SDA pull-up \n\t"
+     " i2c_sbi  %[SDAOUT],%[SDAPIN]     ;enable SDA pull-up \n\t"
 #endif
 #if __AVR_HAVE_JMP_CALL__
             " jmp   _Li2c_put_ack_high \n\t"
@@ -984,9 +2244,9 @@ uint8_t i2c_read(bool last)
 #endif
      "_Li2c_put_ack_low:                ;else \n\t"
 #if I2C_PULLUP
-     " cbi      %[SDAOUT],%[SDAPIN]     ;disable pull-up \n\t"
+     " i2c_cbi  %[SDAOUT],%[SDAPIN]     ;disable pull-up \n\t"
 #endif
-     " sbi  %[SDADDR],%[SDAPIN] ;force SDA low         ;; 7C \n\t"
+     " i2c_sbi %[SDADDR],%[SDAPIN] ;force SDA low         ;; 7C \n\t"
      "_Li2c_put_ack_high: \n\t"
      " nop \n\t "
      " nop \n\t "
@@ -998,19 +2258,23 @@ uint8_t i2c_read(bool last)
             " rcall ass_i2c_delay_half  ;delay T/2             ;; 7C + X \n\t"
 #endif
 #endif
-     " cbi  %[SCLDDR],%[SCLPIN] ;release SCL           ;; 9C +X \n\t"
-#if I2C_PULLUP
-     " sbi      %[SCLOUT],%[SCLPIN] ;enable SCL pull-up \n\t"
+#if !I2C_SCL_PUSHPULL
+     " i2c_cbi %[SCLDDR],%[SCLPIN] ;release SCL           ;; 9C +X \n\t"
+#endif
+#if I2C_PULLUP || I2C_SCL_PUSHPULL
+     " i2c_sbi  %[SCLOUT],%[SCLPIN] ;enable SCL pull-up \n\t"
 #endif
+#if I2C_STRETCH_CHECK
      " cln                              ;clear N               ;; +1 = 10C\n\t"
      " nop \n\t "
      " nop \n\t "
-     " sbis %[SCLIN],%[SCLPIN]  ;wait SCL high         ;; 12C + X\n\t"
+     " i2c_sbis %[SCLIN],%[SCLPIN]  ;wait SCL high         ;; 12C + X\n\t"
 #if __AVR_HAVE_JMP_CALL__
             " call    ass_i2c_wait_scl_high \n\t"
 #else
             " rcall    ass_i2c_wait_scl_high \n\t"
 #endif
+#endif
 #if I2C_DELAY_COUNTER >= 1
 #if __AVR_HAVE_JMP_CALL__
             " call ass_i2c_delay_half  ;delay T/2             ;; 11C + 2X\n\t"
@@ -1021,22 +2285,526 @@ uint8_t i2c_read(bool last)
      "_Li2c_read_return: \n\t"
      " nop \n\t "
      " nop \n\t "
-#if I2C_PULLUP
-     " cbi      %[SCLOUT],%[SCLPIN]     ;disable SCL pull-up \n\t"
+#if I2C_PULLUP || I2C_SCL_PUSHPULL
+     " i2c_cbi  %[SCLOUT],%[SCLPIN]     ;disable SCL pull-up \n\t"
+#endif
+#if !I2C_SCL_PUSHPULL
+     "i2c_sbi %[SCLDDR],%[SCLPIN] ;force SCL low so SCL=H is short\n\t"
 #endif
-     "sbi   %[SCLDDR],%[SCLPIN] ;force SCL low so SCL=H is short\n\t"
      " mov  r24,r23                                        ;; 12C + 2X \n\t"
      " clr  r25                                            ;; 13 C + 2X\n\t"
+#if I2C_NOINTERRUPT == 2
+     " out      __SREG__,r22            ;restore IRQ state \n\t"
+#endif
      " ret                                                     ;; 17C + X"
      ::
-      [SCLDDR] "I"  (SCL_DDR), [SCLPIN] "I" (SCL_PIN), [SCLIN] "I" (SCL_IN),
-      [SDAOUT] "I" (SDA_OUT), [SCLOUT] "I" (SCL_OUT),
-      [SDADDR] "I"  (SDA_DDR), [SDAPIN] "I" (SDA_PIN), [SDAIN] "I" (SDA_IN)
+      [SCLDDR] "n"  (SCL_DDR), [SCLPIN] "I" (SCL_PIN), [SCLIN] "n" (SCL_IN),
+      [SDAOUT] "n" (SDA_OUT), [SCLOUT] "n" (SCL_OUT),
+      [SDADDR] "n"  (SDA_DDR), [SDAPIN] "I" (SDA_PIN), [SDAIN] "n" (SDA_IN)
      );
   return ' '; // fool the compiler!
 }
 #endif
 
+bool i2c_write_P(const uint8_t *data, uint16_t len)
+#if I2C_HARDWARE
+{
+  while (len--)
+    if (!i2c_write(pgm_read_byte(data++))) return false;
+  return true;
+}
+#else
+{
+  __asm__ __volatile__
+    (
+     " push     r28                     ;Y is used as byte counter \n\t"
+     " push     r29 \n\t"
+     " mov      r30,r24                 ;Z points to flash \n\t"
+     " mov      r31,r25 \n\t"
+     " mov      r28,r22 \n\t"
+     " mov      r29,r23 \n\t"
+     " ldi      r24,1                   ;return true if len = 0 \n\t"
+     " cp       r28,__zero_reg__ \n\t"
+     " cpc      r29,__zero_reg__ \n\t"
+     " breq     _Li2c_write_P_done \n\t"
+     "_Li2c_write_P_loop: \n\t"
+#ifdef __AVR_HAVE_LPMX__
+     " lpm      r24,Z+                  ;fetch next byte from flash \n\t"
+#else
+     " lpm                              ;fetch next byte from flash \n\t"
+     " mov      r24,r0 \n\t"
+     " adiw     r30,1 \n\t"
+#endif
+#if __AVR_HAVE_JMP_CALL__
+            " call    ass_i2c_write           ;Z and Y are preserved \n\t"
+#else
+            " rcall    ass_i2c_write           ;Z and Y are preserved \n\t"
+#endif
+     " tst      r24                     ;NAK -> return false \n\t"
+     " breq     _Li2c_write_P_done \n\t"
+     " sbiw     r28,1 \n\t"
+     " brne     _Li2c_write_P_loop \n\t"
+     "_Li2c_write_P_done: \n\t"
+     " pop      r29 \n\t"
+     " pop      r28 \n\t"
+     " clr      r25                     ;clear high byte of return value \n\t"
+     " ret "
+     : : );
+  return true; // fooling the compiler
+}
+#endif
+
+#ifdef RAMPZ
+bool i2c_write_PF(uint_farptr_t data, uint16_t len)
+#if I2C_HARDWARE
+{
+  while (len--)
+    if (!i2c_write(pgm_read_byte_far(data++))) return false;
+  return true;
+}
+#else
+{
+  __asm__ __volatile__
+    (
+     " in       __tmp_reg__,%[RAMPZREG] ;save RAMPZ \n\t"
+     " push     __tmp_reg__ \n\t"
+     " push     r28                     ;Y is used as byte counter \n\t"
+     " push     r29 \n\t"
+     " out      %[RAMPZREG],r24         ;RAMPZ:Z points to flash \n\t"
+     " mov      r30,r22 \n\t"
+     " mov      r31,r23 \n\t"
+     " mov      r28,r20 \n\t"
+     " mov      r29,r21 \n\t"
+     " ldi      r24,1                   ;return true if len = 0 \n\t"
+     " cp       r28,__zero_reg__ \n\t"
+     " cpc      r29,__zero_reg__ \n\t"
+     " breq     _Li2c_write_PF_done \n\t"
+     "_Li2c_write_PF_loop: \n\t"
+     " elpm     r24,Z+                  ;fetch next byte, increments RAMPZ:Z \n\t"
+#if __AVR_HAVE_JMP_CALL__
+            " call    ass_i2c_write           ;Z and Y are preserved \n\t"
+#else
+            " rcall    ass_i2c_write           ;Z and Y are preserved \n\t"
+#endif
+     " tst      r24                     ;NAK -> return false \n\t"
+     " breq     _Li2c_write_PF_done \n\t"
+     " sbiw     r28,1 \n\t"
+     " brne     _Li2c_write_PF_loop \n\t"
+     "_Li2c_write_PF_done: \n\t"
+     " pop      r29 \n\t"
+     " pop      r28 \n\t"
+     " pop      __tmp_reg__             ;restore RAMPZ \n\t"
+     " out      %[RAMPZREG],__tmp_reg__ \n\t"
+     " clr      r25                     ;clear high byte of return value \n\t"
+     " ret "
+     : : [RAMPZREG] "I" (_SFR_IO_ADDR(RAMPZ)));
+  return true; // fooling the compiler
+}
+#endif
+#endif // RAMPZ
+
+bool i2c_probe(uint8_t addr)
+#if I2C_HARDWARE_XT
+{
+  bool      ack = false;
+  uint32_t  start = micros();
+
+  // send START condition and address, wait for ACK/NACK
+  TWI0.MADDR = addr;
+  while (!(TWI0.MSTATUS & (TWI_WIF_bm | TWI_RIF_bm))) {
+    if (micros() - start > I2C_SCAN_PHASE(10)) break;
+  }
+  if (TWI0.MSTATUS & (TWI_WIF_bm | TWI_RIF_bm))
+    ack = !(TWI0.MSTATUS & (TWI_RXACK_bm | TWI_ARBLOST_bm | TWI_BUSERR_bm));
+  // send STOP condition immediately after the ACK bit
+  TWI0.MCTRLB = TWI_ACKACT_NACK_gc | TWI_MCMD_STOP_gc;
+  start = micros();
+  while (((TWI0.MSTATUS & TWI_BUSSTATE_gm) != TWI_BUSSTATE_IDLE_gc) &&
+         (micros() - start <= I2C_SCAN_PHASE(1)));
+  return ack;
+}
+#elif I2C_HARDWARE
+{
+  uint8_t   twst;
+  bool      ack = false;
+  uint32_t  start = micros();
+
+  // send START condition
+  TWCR = (1<<TWINT) | (1<<TWSTA) | (1<<TWEN);
+  while(!(TWCR & (1<<TWINT))) {
+    if (micros() - start > I2C_SCAN_PHASE(1)) return false;
+  }
+  twst = TW_STATUS & 0xF8;
+  if (twst == TW_START || twst == TW_REP_START) {
+    // send device address and wait for ACK/NACK
+    TWDR = addr;
+    TWCR = (1<<TWINT) | (1<<TWEN);
+    start = micros();
+    while(!(TWCR & (1<<TWINT)) && (micros() - start <= I2C_SCAN_PHASE(9)));
+    twst = TW_STATUS & 0xF8;
+    ack = (twst == TW_MT_SLA_ACK) || (twst == TW_MR_SLA_ACK);
+  }
+  // send STOP condition immediately after the ACK bit
+  TWCR = (1<<TWINT) | (1<<TWEN) | (1<<TWSTO);
+  start = micros();
+  while((TWCR & (1<<TWSTO)) && (micros() - start <= I2C_SCAN_PHASE(1)));
+  return ack;
+}
+#else
+{
+  __asm__ __volatile__
+    (
+     I2C_PORT_MACROS
+     I2C_SPEED_SELECT
+     " ldi      r27, %[HISCAN]          ;load stretch budget for this probe \n\t"
+     " ldi      r26, %[LOSCAN] \n\t"
+#if I2C_NOINTERRUPT == 2
+     " in       r22,__SREG__            ;save IRQ state \n\t"
+#endif
+#if I2C_NOINTERRUPT
+     " cli                              ;clear IRQ bit \n\t"
+#endif
+#if __AVR_HAVE_JMP_CALL__
+            " call    _Lprobe_wait_scl   ;wait until SCL=H \n\t"
+#else
+            " rcall    _Lprobe_wait_scl   ;wait until SCL=H \n\t"
+#endif
+     " brne     _Lprobe_free            ;bus is free \n\t"
+#if __AVR_HAVE_JMP_CALL__
+            " jmp     _Lprobe_busy \n\t"
+#else
+            " rjmp     _Lprobe_busy \n\t"
+#endif
+     "_Lprobe_free: \n\t"
+#if I2C_PULLUP
+     " i2c_cbi  %[SDAOUT],%[SDAPIN]     ;disable pull-up \n\t"
+#endif
+     " i2c_sbi  %[SDADDR],%[SDAPIN]     ;force SDA low: start condition \n\t"
+#if __AVR_HAVE_JMP_CALL__
+            " call    ass_i2c_delay_half      ;wait T/2 \n\t"
+#else
+            " rcall    ass_i2c_delay_half      ;wait T/2 \n\t"
+#endif
+     " sec                              ;set carry flag \n\t"
+     " rol      r24                     ;shift in carry and shift out MSB \n\t"
+#if __AVR_HAVE_JMP_CALL__
+            " jmp     _Lprobe_first \n\t"
+#else
+            " rjmp     _Lprobe_first \n\t"
+#endif
+     "_Lprobe_bit: \n\t"
+     " lsl      r24                     ;left shift into carry \n\t"
+     "_Lprobe_first: \n\t"
+     " breq     _Lprobe_ack             ;jump if TXreg is empty \n\t"
+#if I2C_PULLUP || I2C_SCL_PUSHPULL
+     " i2c_cbi  %[SCLOUT],%[SCLPIN]     ;disable SCL pull-up \n\t"
+#endif
+#if !I2C_SCL_PUSHPULL
+     " i2c_sbi  %[SCLDDR],%[SCLPIN]     ;force SCL low \n\t"
+#endif
+     " brcc     _Lprobe_low \n\t"
+     " i2c_cbi  %[SDADDR],%[SDAPIN]     ;release SDA \n\t"
+#if I2C_PULLUP
+     " i2c_sbi  %[SDAOUT],%[SDAPIN]     ;enable SDA pull-up \n\t"
+#endif
+#if __AVR_HAVE_JMP_CALL__
+            " jmp     _Lprobe_high \n\t"
+#else
+            " rjmp     _Lprobe_high \n\t"
+#endif
+     "_Lprobe_low: \n\t"
+#if I2C_PULLUP
+     " i2c_cbi  %[SDAOUT],%[SDAPIN]     ;disable pull-up \n\t"
+#endif
+     " i2c_sbi  %[SDADDR],%[SDAPIN]     ;force SDA low \n\t"
+     "_Lprobe_high: \n\t"
+#if __AVR_HAVE_JMP_CALL__
+            " call    ass_i2c_delay_half      ;delay T/2 \n\t"
+#else
+            " rcall    ass_i2c_delay_half      ;delay T/2 \n\t"
+#endif
+#if !I2C_SCL_PUSHPULL
+     " i2c_cbi  %[SCLDDR],%[SCLPIN]     ;release SCL \n\t"
+#endif
+#if I2C_PULLUP || I2C_SCL_PUSHPULL
+     " i2c_sbi  %[SCLOUT],%[SCLPIN]     ;enable SCL pull-up \n\t"
+#endif
+#if __AVR_HAVE_JMP_CALL__
+            " call    _Lprobe_wait_scl   ;wait until SCL=H \n\t"
+#else
+            " rcall    _Lprobe_wait_scl   ;wait until SCL=H \n\t"
+#endif
+     " breq     _Lprobe_timeout         ;stretched too long \n\t"
+#if __AVR_HAVE_JMP_CALL__
+            " call    ass_i2c_delay_half      ;delay T/2 \n\t"
+#else
+            " rcall    ass_i2c_delay_half      ;delay T/2 \n\t"
+#endif
+#if __AVR_HAVE_JMP_CALL__
+            " jmp     _Lprobe_bit \n\t"
+#else
+            " rjmp     _Lprobe_bit \n\t"
+#endif
+     "_Lprobe_ack: \n\t"
+#if I2C_PULLUP || I2C_SCL_PUSHPULL
+     " i2c_cbi  %[SCLOUT],%[SCLPIN]     ;disable SCL pull-up \n\t"
+#endif
+#if !I2C_SCL_PUSHPULL
+     " i2c_sbi  %[SCLDDR],%[SCLPIN]     ;force SCL low \n\t"
+#endif
+     " i2c_cbi  %[SDADDR],%[SDAPIN]     ;release SDA \n\t"
+#if I2C_PULLUP
+     " i2c_sbi  %[SDAOUT],%[SDAPIN]     ;enable SDA pull-up \n\t"
+#endif
+#if __AVR_HAVE_JMP_CALL__
+            " call    ass_i2c_delay_half      ;delay T/2 \n\t"
+#else
+            " rcall    ass_i2c_delay_half      ;delay T/2 \n\t"
+#endif
+#if !I2C_SCL_PUSHPULL
+     " i2c_cbi  %[SCLDDR],%[SCLPIN]     ;release SCL \n\t"
+#endif
+#if I2C_PULLUP || I2C_SCL_PUSHPULL
+     " i2c_sbi  %[SCLOUT],%[SCLPIN]     ;enable SCL pull-up \n\t"
+#endif
+#if __AVR_HAVE_JMP_CALL__
+            " call    _Lprobe_wait_scl   ;wait until SCL=H \n\t"
+#else
+            " rcall    _Lprobe_wait_scl   ;wait until SCL=H \n\t"
+#endif
+     " breq     _Lprobe_timeout         ;stretched too long \n\t"
+     " i2c_sbis %[SDAIN],%[SDAPIN]      ;if SDA hi -> return false \n\t"
+     " ldi      r24,1                   ;return true \n\t"
+#if __AVR_HAVE_JMP_CALL__
+            " call    ass_i2c_delay_half      ;delay T/2 \n\t"
+#else
+            " rcall    ass_i2c_delay_half      ;delay T/2 \n\t"
+#endif
+#if __AVR_HAVE_JMP_CALL__
+            " jmp     _Lprobe_stop \n\t"
+#else
+            " rjmp     _Lprobe_stop \n\t"
+#endif
+     "_Lprobe_busy:                     ;SCL low before start: leave the bus alone \n\t"
+     " clr      r24                     ;return false \n\t"
+#if __AVR_HAVE_JMP_CALL__
+            " jmp     _Lprobe_return \n\t"
+#else
+            " rjmp     _Lprobe_return \n\t"
+#endif
+     "_Lprobe_timeout: \n\t"
+     " clr      r24                     ;return false \n\t"
+     " adiw     r26,1                   ;leave budget empty for the stop condition \n\t"
+     "_Lprobe_stop:                     ;abort right after the ACK bit \n\t"
+#if I2C_PULLUP || I2C_SCL_PUSHPULL
+     " i2c_cbi  %[SCLOUT],%[SCLPIN]     ;disable SCL pull-up \n\t"
+#endif
+#if !I2C_SCL_PUSHPULL
+     " i2c_sbi  %[SCLDDR],%[SCLPIN]     ;force SCL low \n\t"
+#endif
+#if I2C_PULLUP
+     " i2c_cbi  %[SDAOUT],%[SDAPIN]     ;disable pull-up \n\t"
+#endif
+     " i2c_sbi  %[SDADDR],%[SDAPIN]     ;force SDA low \n\t"
+#if __AVR_HAVE_JMP_CALL__
+            " call    ass_i2c_delay_half      ;T/2 delay \n\t"
+#else
+            " rcall    ass_i2c_delay_half      ;T/2 delay \n\t"
+#endif
+#if !I2C_SCL_PUSHPULL
+     " i2c_cbi  %[SCLDDR],%[SCLPIN]     ;release SCL \n\t"
+#endif
+#if I2C_PULLUP || I2C_SCL_PUSHPULL
+     " i2c_sbi  %[SCLOUT],%[SCLPIN]     ;enable SCL pull-up \n\t"
+#endif
+#if __AVR_HAVE_JMP_CALL__
+            " call    ass_i2c_delay_half      ;T/2 delay \n\t"
+#else
+            " rcall    ass_i2c_delay_half      ;T/2 delay \n\t"
+#endif
+#if __AVR_HAVE_JMP_CALL__
+            " call    _Lprobe_wait_scl   ;wait until SCL=H \n\t"
+#else
+            " rcall    _Lprobe_wait_scl   ;wait until SCL=H \n\t"
+#endif
+     " i2c_cbi  %[SDADDR],%[SDAPIN]     ;release SDA: stop condition \n\t"
+#if I2C_PULLUP
+     " i2c_sbi  %[SDAOUT],%[SDAPIN]     ;enable SDA pull-up \n\t"
+#endif
+#if __AVR_HAVE_JMP_CALL__
+            " call    ass_i2c_delay_half \n\t"
+#else
+            " rcall    ass_i2c_delay_half \n\t"
+#endif
+     "_Lprobe_return: \n\t"
+#if I2C_NOINTERRUPT == 1
+     " sei                              ;enable interrupts again!\n\t"
+#elif I2C_NOINTERRUPT == 2
+     " out      __SREG__,r22            ;restore IRQ state \n\t"
+#endif
+     " clr      r25                     ;clear high byte of return value \n\t"
+     " ret \n\t"
+     "_Lprobe_wait_scl:                 ;wait for SCL=H, Z=1 on timeout \n\t"
+     " sbiw     r26,1                   ;consume stretch budget   ;; 2C \n\t"
+     " breq     _Lprobe_wait_done       ;budget exhausted         ;; +1 = 3C \n\t"
+     " i2c_sbis %[SCLIN],%[SCLPIN]      ;skip if SCL high         ;; +1 = 4C \n\t"
+#if __AVR_HAVE_JMP_CALL__
+            " jmp     _Lprobe_wait_scl      ;; +2 = 6C \n\t"
+#else
+            " rjmp     _Lprobe_wait_scl      ;; +2 = 6C \n\t"
+#endif
+     "_Lprobe_wait_done: \n\t"
+     " ret                              ;Z=0 if SCL high "
+     : : [SCLDDR] "n"  (SCL_DDR), [SCLPIN] "I" (SCL_PIN), [SCLIN] "n" (SCL_IN),
+       [SDAOUT] "n" (SDA_OUT), [SCLOUT] "n" (SCL_OUT),
+       [SDADDR] "n"  (SDA_DDR), [SDAPIN] "I" (SDA_PIN), [SDAIN] "n" (SDA_IN),
+       [HISCAN] "M" (I2C_SCAN_STRETCH>>8),
+       [LOSCAN] "M" (I2C_SCAN_STRETCH&0xFF)
+     : "r22", "r26", "r27");
+  return true; // fooling the compiler
+}
+#endif
+
+bool i2c_scan(uint8_t *map, uint8_t first, uint8_t last)
+{
+  uint8_t addr;
+
+  for (addr = 0; addr < 16; addr++) map[addr] = 0;
+  if (last > 0x7F) last = 0x7F;
+  for (addr = first; addr <= last; addr++) {
+    // the bus has to be idle between two probes, otherwise it is locked up
+#if I2C_HARDWARE
+    if (digitalRead(SDA) == 0 || digitalRead(SCL) == 0) return false;
+#else
+    if (!(_SFR_IO8(SDA_IN) & _BV(SDA_PIN)) || !(_SFR_IO8(SCL_IN) & _BV(SCL_PIN)))
+      return false;
+#endif
+    if (i2c_probe((addr<<1)|I2C_WRITE)) map[addr>>3] |= (1<<(addr&7));
+  }
+  return true;
+}
+
+#if !I2C_HARDWARE
+// cycles of one iteration of the counting loop of i2c_rise_time
+#define I2C_RISE_SDA_LOOP (SDA_IN >= 0x20 ? 8 : 6)
+#define I2C_RISE_SCL_LOOP (SCL_IN >= 0x20 ? 8 : 6)
+
+uint16_t i2c_rise_time(bool scl)
+{
+  uint16_t count;
+  uint32_t ns;
+  uint8_t sreg = SREG;
+
+#if I2C_SCL_PUSHPULL
+  if (scl) return 0; // SCL is driven high
+#endif
+  cli();
+  if (scl)
+    __asm__ __volatile__
+      (
+       I2C_PORT_MACROS
+#if I2C_PULLUP
+       " i2c_cbi  %[SCLOUT],%[SCLPIN]     ;disable SCL pull-up \n\t"
+#endif
+       " i2c_sbi  %[SCLDDR],%[SCLPIN]     ;force SCL low \n\t"
+       " clr      %A[count] \n\t"
+       " clr      %B[count] \n\t"
+       " i2c_cbi  %[SCLDDR],%[SCLPIN]     ;release SCL \n\t"
+#if I2C_PULLUP
+       " i2c_sbi  %[SCLOUT],%[SCLPIN]     ;enable SCL pull-up \n\t"
+#endif
+       "1: \n\t"
+       " adiw     %[count],1              ;count until SCL is high ;; 2C \n\t"
+       " breq     2f                      ;timeout \n\t"
+       " i2c_sbis %[SCLIN],%[SCLPIN] \n\t"
+       " rjmp     1b                                             ;; 6C \n\t"
+       "2: \n\t"
+       : [count] "=&w" (count)
+       : [SCLDDR] "n"  (SCL_DDR), [SCLPIN] "I" (SCL_PIN), [SCLIN] "n" (SCL_IN),
+         [SCLOUT] "n" (SCL_OUT)
+       : "r18", "r19");
+  else // SCL is held low, so that no start or stop condition is sent
+    __asm__ __volatile__
+      (
+       I2C_PORT_MACROS
+#if I2C_PULLUP || I2C_SCL_PUSHPULL
+       " i2c_cbi  %[SCLOUT],%[SCLPIN]     ;disable SCL pull-up \n\t"
+#endif
+#if !I2C_SCL_PUSHPULL
+       " i2c_sbi  %[SCLDDR],%[SCLPIN]     ;force SCL low \n\t"
+#endif
+#if I2C_PULLUP
+       " i2c_cbi  %[SDAOUT],%[SDAPIN]     ;disable SDA pull-up \n\t"
+#endif
+       " i2c_sbi  %[SDADDR],%[SDAPIN]     ;force SDA low \n\t"
+       " clr      %A[count] \n\t"
+       " clr      %B[count] \n\t"
+       " i2c_cbi  %[SDADDR],%[SDAPIN]     ;release SDA \n\t"
+#if I2C_PULLUP
+       " i2c_sbi  %[SDAOUT],%[SDAPIN]     ;enable SDA pull-up \n\t"
+#endif
+       "1: \n\t"
+       " adiw     %[count],1              ;count until SDA is high ;; 2C \n\t"
+       " breq     2f                      ;timeout \n\t"
+       " i2c_sbis %[SDAIN],%[SDAPIN] \n\t"
+       " rjmp     1b                                             ;; 6C \n\t"
+       "2: \n\t"
+#if !I2C_SCL_PUSHPULL
+       " i2c_cbi  %[SCLDDR],%[SCLPIN]     ;release SCL \n\t"
+#endif
+#if I2C_PULLUP || I2C_SCL_PUSHPULL
+       " i2c_sbi  %[SCLOUT],%[SCLPIN]     ;enable SCL pull-up \n\t"
+#endif
+       : [count] "=&w" (count)
+       : [SCLDDR] "n"  (SCL_DDR), [SCLPIN] "I" (SCL_PIN), [SCLOUT] "n" (SCL_OUT),
+         [SDADDR] "n"  (SDA_DDR), [SDAPIN] "I" (SDA_PIN), [SDAIN] "n" (SDA_IN),
+         [SDAOUT] "n" (SDA_OUT)
+       : "r18", "r19");
+  SREG = sreg;
+  if (count == 0) return 0xFFFF;
+  // time until the input reads high, i.e., until the line crosses 0.6 VDD
+  ns = (uint32_t)count * (scl ? I2C_RISE_SCL_LOOP : I2C_RISE_SDA_LOOP) * (1000000000UL/I2C_CPUFREQ);
+  // an RC curve reaches 0.6 VDD after 0.92 RC and rises from 0.3 to 0.7 VDD in 0.85 RC
+  ns = ns / 40 * 37;
+  return (ns > 0xFFFE ? 0xFFFE : ns);
+}
+#endif
+
+uint16_t i2c_max_scl_khz(uint16_t rise)
+{
+  // maximal rise times of the I2C specification, slow mode scaled from standard mode
+  if (rise <= 300) return 400;
+  if (rise <= 1000) return 100;
+  if (rise <= 4000) return 25;
+  return 100000UL / rise;
+}
+
+#if I2C_SPEEDSWITCH
+void i2c_set_speed(uint8_t addr, uint8_t speed)
+{
+  uint8_t *p = &i2c_speed_map[addr >> 3];
+  *p = (*p & ~(3 << (addr & 6))) | ((speed & 3) << (addr & 6));
+}
+
+uint8_t i2c_get_speed(uint8_t addr)
+{
+  return (i2c_speed_map[addr >> 3] >> (addr & 6)) & 3;
+}
+
+uint8_t i2c_negotiate_speed(uint8_t addr, bool (*verify)(uint8_t addr), uint8_t tries)
+{
+  uint8_t speed, i;
+
+  for (speed = I2C_SPEED_FAST; speed > I2C_SPEED_DEFAULT; speed--) {
+    i2c_set_speed(addr, speed);
+    for (i = 0; i < tries && verify(addr); i++);
+    if (i == tries) return speed;
+  }
+  i2c_set_speed(addr, I2C_SPEED_DEFAULT);
+  return I2C_SPEED_DEFAULT;
+}
+#endif
+
 #pragma GCC diagnostic pop
 
 #endif // !defined(USE_SOFT_I2C_MASTER_H_AS_PLAIN_INCLUDE)
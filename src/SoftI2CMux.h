@@ -0,0 +1,86 @@
+/*
+  SoftI2CMux.h - Devices behind a TCA9548A I2C multiplexer for SoftI2CMaster
+  Copyright (c) 2026 Bernhard Nebel.
+
+  This file is part of SoftI2CMaster https://github.com/felias-fogg/SoftI2CMaster.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef _SoftI2CMux_h
+#define _SoftI2CMux_h
+
+#include <inttypes.h>
+
+// Logical address of the device with 8-bit address <addr> (including the R/W
+// bit) on downstream channel <chan> (0-7) of the multiplexer. Plain 8-bit
+// addresses denote devices on the upstream bus, which are always reachable.
+#define I2C_MUX_ADDR(chan, addr) ((uint16_t)(((chan)+1) << 8) | (addr))
+
+// channel states
+#define I2C_MUX_NONE    0xFF // all channels disabled
+#define I2C_MUX_UNKNOWN 0xFE // state of the multiplexer not known
+
+class I2CMux {
+ public:
+  // <addr> is the 8-bit address of the multiplexer (0xE0 ... 0xEE)
+  I2CMux(uint8_t addr = 0xE0) : _addr(addr), _chan(I2C_MUX_UNKNOWN) { }
+  // connect channel <chan> (or none with I2C_MUX_NONE); no bus access if it is already connected
+  bool select(uint8_t chan);
+  // i2c_start/i2c_start_wait for a logical address, selecting the channel if necessary;
+  // use i2c_rep_start, i2c_write, i2c_read, and i2c_stop as usual afterwards
+  bool start(uint16_t laddr);
+  bool start_wait(uint16_t laddr);
+  // the channel currently connected
+  uint8_t channel(void) { return _chan; }
+  // forget the channel, e.g., after a bus recovery or a reset of the multiplexer
+  void invalidate(void) { _chan = I2C_MUX_UNKNOWN; }
+
+ private:
+  uint8_t _addr, _chan;
+};
+
+#if !defined(USE_SOFTI2CMUX_H_AS_PLAIN_INCLUDE)
+/*
+ * The implementation part of the header only library starts here
+ */
+#include <SoftI2CMaster.h>
+
+bool I2CMux::select(uint8_t chan)
+{
+  bool ok;
+  if (chan == _chan) return true;
+  ok = i2c_start(_addr) && i2c_write(chan == I2C_MUX_NONE ? 0 : (1 << chan));
+  i2c_stop();
+  _chan = (ok ? chan : I2C_MUX_UNKNOWN);
+  return ok;
+}
+
+bool I2CMux::start(uint16_t laddr)
+{
+  if ((laddr >> 8) && !select((laddr >> 8) - 1)) return false;
+  return i2c_start(laddr & 0xFF);
+}
+
+bool I2CMux::start_wait(uint16_t laddr)
+{
+  if ((laddr >> 8) && !select((laddr >> 8) - 1)) return false;
+  return i2c_start_wait(laddr & 0xFF);
+}
+
+#endif // !defined(USE_SOFTI2CMUX_H_AS_PLAIN_INCLUDE)
+
+#endif // #ifndef _SoftI2CMux_h
+#pragma once
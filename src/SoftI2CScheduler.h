@@ -0,0 +1,166 @@
+/*
+  SoftI2CScheduler.h - Periodic polling of I2C devices with bus-time budgeting
+  Copyright (c) 2026 Bernhard Nebel.
+
+  This file is part of SoftI2CMaster https://github.com/felias-fogg/SoftI2CMaster.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef _SoftI2CScheduler_h
+#define _SoftI2CScheduler_h
+
+#include <inttypes.h>
+
+// A task is one bus transaction (or a short sequence of them) that is
+// released every <period> msec and should be finished <deadline> msec after
+// its release. A deadline of 0 marks a background task, which is only run
+// when it does not make another task miss its deadline. <cost> is the
+// estimated time of the task in usec. The function returns the number of
+// msec the device needs before it can be accessed again (e.g., 5 after an
+// EEPROM page write), usually 0. The task is not run again before that time,
+// and the other tasks use the bus in the meantime.
+struct I2CTask {
+  uint16_t (*func)(void);
+  uint16_t period;   // msec
+  uint16_t deadline; // msec after release, 0 = background
+  uint16_t cost;     // usec
+  // filled in by the scheduler
+  uint32_t release;  // usec timestamp of the pending or next release
+  uint32_t holdoff;  // usec timestamp before which the task is not run
+  uint16_t missed;   // number of deadlines missed (late or skipped jobs)
+  uint16_t maxtime;  // longest measured run time in usec
+};
+
+class I2CScheduler {
+ public:
+  // <tasks> is an array of <count> tasks, initialized with func, period, deadline, and cost
+  I2CScheduler(I2CTask *tasks, uint8_t count) : _tasks(tasks), _count(count) { }
+  // release all tasks now and reset the statistics
+  void begin(void);
+  // run the most urgent task if this does not endanger the deadline of another one
+  // Return: true if a task has been run
+  bool run(void);
+  // percentage of the time spent in tasks since begin or resetStats
+  uint8_t utilization(void);
+  // number of missed deadlines of all tasks
+  uint16_t missed(void);
+  void resetStats(void);
+
+ private:
+  I2CTask *_tasks;
+  uint8_t _count;
+  uint32_t _last, _busy, _elapsed;
+};
+
+#if !defined(USE_SOFTI2CSCHEDULER_H_AS_PLAIN_INCLUDE)
+/*
+ * The implementation part of the header only library starts here
+ */
+#include <Arduino.h>
+
+// usec timestamps are compared by their signed difference so that they may wrap around
+#define I2C_SCHED_BEFORE(a, b) ((int32_t)((a) - (b)) < 0)
+
+void I2CScheduler::begin(void)
+{
+  uint32_t now = micros();
+  for (uint8_t i = 0; i < _count; i++) {
+    _tasks[i].release = now;
+    _tasks[i].holdoff = now;
+  }
+  resetStats();
+}
+
+void I2CScheduler::resetStats(void)
+{
+  for (uint8_t i = 0; i < _count; i++) {
+    _tasks[i].missed = 0;
+    _tasks[i].maxtime = 0;
+  }
+  _last = micros();
+  _busy = 0;
+  _elapsed = 0;
+}
+
+bool I2CScheduler::run(void)
+{
+  uint32_t now = micros(), end, due, latest;
+  I2CTask *t, *next = NULL;
+  uint8_t i;
+
+  _elapsed += now - _last;
+  _last = now;
+  if (_elapsed & 0x80000000UL) { // keep the ratio, avoid the overflow
+    _elapsed >>= 1;
+    _busy >>= 1;
+  }
+  // skipped jobs count as missed; among the released tasks, pick the one
+  // with the earliest deadline (background tasks last)
+  for (i = 0, t = _tasks; i < _count; i++, t++) {
+    while (t->period && !I2C_SCHED_BEFORE(now, t->release + t->period*1000UL)) {
+      t->release += t->period*1000UL;
+      if (t->deadline) t->missed++;
+    }
+    if (I2C_SCHED_BEFORE(now, t->release) || I2C_SCHED_BEFORE(now, t->holdoff)) continue;
+    if (next == NULL || (t->deadline &&
+                         (next->deadline == 0 ||
+                          I2C_SCHED_BEFORE(t->release + t->deadline*1000UL,
+                                           next->release + next->deadline*1000UL))))
+      next = t;
+  }
+  if (next == NULL) return false;
+  // a task that still has slack must not delay the latest start of a task
+  // that becomes ready while it runs; rather leave the bus idle
+  end = now + next->cost;
+  if (next->deadline == 0 ||
+      I2C_SCHED_BEFORE(end, next->release + next->deadline*1000UL - next->cost)) {
+    for (i = 0, t = _tasks; i < _count; i++, t++) {
+      if (t->deadline == 0) continue;
+      due = (I2C_SCHED_BEFORE(t->release, t->holdoff) ? t->holdoff : t->release);
+      if (!I2C_SCHED_BEFORE(now, due)) continue; // ready now, EDF has taken care of it
+      latest = t->release + t->deadline*1000UL - t->cost;
+      if (I2C_SCHED_BEFORE(due, end) && I2C_SCHED_BEFORE(latest, end)) return false;
+    }
+  }
+  // run it
+  uint16_t holdoff = next->func();
+  end = micros();
+  if (end - now > next->maxtime) next->maxtime = (end - now > 0xFFFF ? 0xFFFF : end - now);
+  _busy += end - now;
+  if (next->deadline && I2C_SCHED_BEFORE(next->release + next->deadline*1000UL, end))
+    next->missed++;
+  next->release += next->period*1000UL;
+  next->holdoff = end + holdoff*1000UL;
+  return true;
+}
+
+uint8_t I2CScheduler::utilization(void)
+{
+  if (_elapsed < 100) return 0;
+  return _busy / (_elapsed / 100);
+}
+
+uint16_t I2CScheduler::missed(void)
+{
+  uint16_t sum = 0;
+  for (uint8_t i = 0; i < _count; i++) sum += _tasks[i].missed;
+  return sum;
+}
+
+#endif // !defined(USE_SOFTI2CSCHEDULER_H_AS_PLAIN_INCLUDE)
+
+#endif // #ifndef _SoftI2CScheduler_h
+#pragma once
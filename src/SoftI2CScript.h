@@ -0,0 +1,138 @@
+/*
+  SoftI2CScript.h - Compact bytecode for I2C transactions and its interpreter
+  Copyright (c) 2026 Bernhard Nebel.
+
+  This file is part of SoftI2CMaster https://github.com/felias-fogg/SoftI2CMaster.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef _SoftI2CScript_h
+#define _SoftI2CScript_h
+
+#include <inttypes.h>
+
+// A script is a sequence of instructions, each consisting of an opcode byte
+// and an argument byte. Only I2C_OP_WRITE and I2C_OP_FILL are followed by
+// further bytes, and I2C_OP_END has no argument. Counts are between 1 and 255.
+#define I2C_OP_END        0x00 // end of script
+#define I2C_OP_START      0x01 // <addr>: start (or repeated start if the bus is taken)
+#define I2C_OP_START_WAIT 0x02 // <addr>: like I2C_OP_START, retried after NAKs (max 255)
+#define I2C_OP_STOP       0x03 // <n>: n stop conditions, 1 usec apart
+#define I2C_OP_WRITE      0x04 // <n> <byte 1> ... <byte n>: write n bytes
+#define I2C_OP_FILL       0x05 // <n> <byte>: write byte n times
+#define I2C_OP_READ       0x06 // <n>: read n bytes, all answered with ACK
+#define I2C_OP_READ_LAST  0x07 // <n>: read n bytes, the last one answered with NAK
+#define I2C_OP_DELAY_US   0x08 // <n>: pause for n usec
+#define I2C_OP_DELAY_MS   0x09 // <n>: pause for n msec
+
+// memory the script is fetched from
+#define I2C_SCRIPT_RAM     0
+#define I2C_SCRIPT_PROGMEM 1
+#define I2C_SCRIPT_EEPROM  2
+
+// flags for i2c_run_script
+#define I2C_SCRIPT_TRACE   0x01 // record ACKs and continue after NAKs
+
+// Execute the script at <code> stored in memory <mem>. The bytes read are stored
+// into <res>. If I2C_SCRIPT_TRACE is set, then additionally for each address
+// and each written byte, 1 (ACK) or 0 (NAK) is stored into <res>, preceded by
+// the number of NAKs received before for I2C_OP_START_WAIT. Otherwise the script
+// is aborted with a stop condition at the first NAK. If the bus is still taken
+// at the end of the script, a stop condition is sent.
+// Return: true if all addresses and bytes were acknowledged
+bool i2c_run_script(const uint8_t *code, uint8_t mem, uint8_t *res, uint8_t flags = 0);
+
+#if !defined(USE_SOFTI2CSCRIPT_H_AS_PLAIN_INCLUDE)
+/*
+ * The implementation part of the header only library starts here
+ */
+#include <SoftI2CMaster.h>
+#include <avr/eeprom.h>
+
+static inline __attribute__ ((always_inline)) uint8_t i2c_script_fetch(const uint8_t *p, uint8_t mem)
+{
+  if (mem == I2C_SCRIPT_PROGMEM) return pgm_read_byte(p);
+  if (mem == I2C_SCRIPT_EEPROM) return eeprom_read_byte(p);
+  return *p;
+}
+
+bool i2c_run_script(const uint8_t *code, uint8_t mem, uint8_t *res, uint8_t flags)
+{
+  bool taken = false, ok = true, ack = true;
+  uint8_t op, arg, val, naks;
+
+  while ((op = i2c_script_fetch(code++, mem)) != I2C_OP_END) {
+    arg = i2c_script_fetch(code++, mem);
+    switch (op) {
+    case I2C_OP_START:
+    case I2C_OP_START_WAIT:
+      naks = 0;
+      while (!(ack = (taken ? i2c_rep_start(arg) : i2c_start(arg))) &&
+             op == I2C_OP_START_WAIT && naks < 255) {
+        i2c_stop();
+        taken = false;
+        naks++;
+      }
+      taken = true;
+      if (flags & I2C_SCRIPT_TRACE) {
+        if (op == I2C_OP_START_WAIT) *res++ = naks;
+        *res++ = ack;
+      }
+      break;
+    case I2C_OP_STOP:
+      do {
+        i2c_stop();
+        delayMicroseconds(1);
+      } while (--arg);
+      taken = false;
+      break;
+    case I2C_OP_WRITE:
+    case I2C_OP_FILL:
+      do {
+        ack = i2c_write(i2c_script_fetch(code, mem));
+        if (op == I2C_OP_WRITE || arg == 1) code++;
+        if (flags & I2C_SCRIPT_TRACE) *res++ = ack;
+        else if (!ack) break;
+      } while (--arg);
+      break;
+    case I2C_OP_READ:
+    case I2C_OP_READ_LAST:
+      do {
+        val = i2c_read(op == I2C_OP_READ_LAST && arg == 1);
+        *res++ = val;
+      } while (--arg);
+      break;
+    case I2C_OP_DELAY_US:
+      delayMicroseconds(arg);
+      break;
+    case I2C_OP_DELAY_MS:
+      delay(arg);
+      break;
+    }
+    if (!ack) {
+      ok = false;
+      if (!(flags & I2C_SCRIPT_TRACE)) break;
+      ack = true;
+    }
+  }
+  if (taken) i2c_stop();
+  return ok;
+}
+
+#endif // !defined(USE_SOFTI2CSCRIPT_H_AS_PLAIN_INCLUDE)
+
+#endif // #ifndef _SoftI2CScript_h
+#pragma once
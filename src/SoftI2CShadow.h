@@ -0,0 +1,146 @@
+/*
+  SoftI2CShadow.h - RAM copies of device configuration registers for SoftI2CMaster
+  Copyright (c) 2026 Bernhard Nebel.
+
+  This file is part of SoftI2CMaster https://github.com/felias-fogg/SoftI2CMaster.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef _SoftI2CShadow_h
+#define _SoftI2CShadow_h
+
+#include <inttypes.h>
+
+// Write-through cache for the registers <first> ... <first>+<count>-1 of the
+// device with the 8-bit address <addr>. A register is selected by writing
+// <cmd> | <reg> after the address (e.g., 0x80 as the command bit of the
+// TSL2561). All register arguments must be inside the cached range.
+class I2CShadowRegs {
+ public:
+  I2CShadowRegs(uint8_t addr, uint8_t first, uint8_t count, uint8_t *regs, uint8_t cmd);
+
+  // write <val> to <reg>, no bus access if the cached value is equal
+  bool write(uint8_t reg, uint8_t val);
+  // replace the bits of <reg> selected by <mask> with those of <val>;
+  // the register is only read if it is not cached yet
+  bool update(uint8_t reg, uint8_t mask, uint8_t val);
+  // get the value of <reg>, read from the device if it is not cached
+  bool read(uint8_t reg, uint8_t &val);
+  // forget all cached values, e.g., after a bus recovery or a device reset
+  void invalidate(void) { _valid = 0; }
+  // read all registers from the device
+  bool resync(void);
+  // write all cached values back, e.g., after the device lost power
+  bool restore(void);
+
+ private:
+  bool fetch(uint8_t i);
+  bool store(uint8_t i, uint8_t val);
+
+  uint8_t _addr, _first, _count, _cmd;
+  uint16_t _valid;
+  uint8_t *_regs;
+};
+
+// cache for <count> registers (at most 16)
+template<uint8_t count> class I2CShadow : public I2CShadowRegs {
+  static_assert(count > 0 && count <= 16, "I2CShadow: between 1 and 16 registers");
+ public:
+  I2CShadow(uint8_t addr, uint8_t first, uint8_t cmd = 0) :
+    I2CShadowRegs(addr, first, count, _store, cmd) { }
+ private:
+  uint8_t _store[count];
+};
+
+#if !defined(USE_SOFTI2CSHADOW_H_AS_PLAIN_INCLUDE)
+/*
+ * The implementation part of the header only library starts here
+ */
+#include <SoftI2CMaster.h>
+
+I2CShadowRegs::I2CShadowRegs(uint8_t addr, uint8_t first, uint8_t count, uint8_t *regs, uint8_t cmd) :
+  _addr(addr), _first(first), _count(count), _cmd(cmd), _valid(0), _regs(regs)
+{
+}
+
+bool I2CShadowRegs::fetch(uint8_t i)
+{
+  bool ok = i2c_start(_addr) && i2c_write(_cmd | (_first + i)) && i2c_rep_start(_addr | 1);
+  if (ok) {
+    _regs[i] = i2c_read(true);
+    _valid |= (1U << i);
+  }
+  i2c_stop();
+  return ok;
+}
+
+bool I2CShadowRegs::store(uint8_t i, uint8_t val)
+{
+  bool ok = i2c_start(_addr) && i2c_write(_cmd | (_first + i)) && i2c_write(val);
+  i2c_stop();
+  if (ok) {
+    _regs[i] = val;
+    _valid |= (1U << i);
+  } else {
+    _valid &= ~(1U << i); // we do not know what the device got
+  }
+  return ok;
+}
+
+bool I2CShadowRegs::write(uint8_t reg, uint8_t val)
+{
+  uint8_t i = reg - _first;
+  if ((_valid & (1U << i)) && _regs[i] == val) return true;
+  return store(i, val);
+}
+
+bool I2CShadowRegs::update(uint8_t reg, uint8_t mask, uint8_t val)
+{
+  uint8_t i = reg - _first;
+  if (!(_valid & (1U << i)) && !fetch(i)) return false;
+  return write(reg, (_regs[i] & ~mask) | (val & mask));
+}
+
+bool I2CShadowRegs::read(uint8_t reg, uint8_t &val)
+{
+  uint8_t i = reg - _first;
+  if (!(_valid & (1U << i)) && !fetch(i)) return false;
+  val = _regs[i];
+  return true;
+}
+
+bool I2CShadowRegs::resync(void)
+{
+  bool ok = true;
+  _valid = 0;
+  for (uint8_t i = 0; i < _count; i++)
+    ok = fetch(i) && ok;
+  return ok;
+}
+
+bool I2CShadowRegs::restore(void)
+{
+  bool ok = true;
+  for (uint8_t i = 0; i < _count; i++)
+    if (_valid & (1U << i))
+      ok = store(i, _regs[i]) && ok;
+  return ok;
+}
+
+#endif // !defined(USE_SOFTI2CSHADOW_H_AS_PLAIN_INCLUDE)
+
+#endif // #ifndef _SoftI2CShadow_h
+#pragma once
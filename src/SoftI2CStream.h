@@ -0,0 +1,84 @@
+/*
+  SoftI2CStream.h - Streaming bulk reads from SoftI2CMaster to a Print object
+  Copyright (c) 2026 Bernhard Nebel.
+
+  This file is part of SoftI2CMaster https://github.com/felias-fogg/SoftI2CMaster.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef _SoftI2CStream_h
+#define _SoftI2CStream_h
+
+#include <inttypes.h>
+#include "Print.h"
+
+// Size of the ring buffer between bus and sink (on the stack), must be a
+// power of 2 between 2 and 128
+#ifndef I2C_STREAM_BUFFER
+  #define I2C_STREAM_BUFFER 16
+#endif
+
+#if I2C_STREAM_BUFFER < 2 || I2C_STREAM_BUFFER > 128 || (I2C_STREAM_BUFFER & (I2C_STREAM_BUFFER-1))
+  #error I2C_STREAM_BUFFER must be a power of 2 between 2 and 128
+#endif
+
+// Read <len> bytes from the slave that has been addressed for reading by the
+// previous i2c_start/i2c_rep_start call and write them to <out>. The last byte
+// is answered with a NAK, but no stop condition is sent. While <out> cannot take
+// another byte without blocking (according to availableForWrite), the
+// next bytes are read from the bus into the buffer.
+// Return: the number of bytes written to <out>
+size_t i2c_read_stream(Print &out, size_t len);
+
+#if !defined(USE_SOFTI2CSTREAM_H_AS_PLAIN_INCLUDE)
+/*
+ * The implementation part of the header only library starts here
+ */
+#include <SoftI2CMaster.h>
+
+size_t i2c_read_stream(Print &out, size_t len)
+{
+  uint8_t buf[I2C_STREAM_BUFFER];
+  uint8_t head = 0, tail = 0, fill = 0;
+  size_t written = 0;
+
+  while (len > 0 || fill > 0) {
+    // hand over everything the sink accepts without blocking
+    while (fill > 0 && out.availableForWrite() > 0) {
+      written += out.write(buf[tail]);
+      tail = (tail + 1) & (I2C_STREAM_BUFFER - 1);
+      fill--;
+    }
+    if (len > 0 && fill < I2C_STREAM_BUFFER) {
+      // sink is busy: use the time to read the next byte
+      len--;
+      buf[head] = i2c_read(len == 0);
+      head = (head + 1) & (I2C_STREAM_BUFFER - 1);
+      fill++;
+    } else if (fill > 0) {
+      // buffer full or bus done: nothing left to do but wait for the sink
+      written += out.write(buf[tail]);
+      tail = (tail + 1) & (I2C_STREAM_BUFFER - 1);
+      fill--;
+    }
+  }
+  return written;
+}
+
+#endif // !defined(USE_SOFTI2CSTREAM_H_AS_PLAIN_INCLUDE)
+
+#endif // #ifndef _SoftI2CStream_h
+#pragma once
@@ -0,0 +1,136 @@
+/*
+  SoftI2CTransaction.h - Compile-time descriptions of I2C transactions for SoftI2CMaster
+  Copyright (c) 2026 Bernhard Nebel.
+
+  This file is part of SoftI2CMaster https://github.com/felias-fogg/SoftI2CMaster.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef _SoftI2CTransaction_h
+#define _SoftI2CTransaction_h
+
+#include <inttypes.h>
+#include <SoftI2CMaster.h>
+
+// A transaction is described by a type, e.g.,
+//
+//   typedef I2CTransaction< I2CWrite<0x72, 0x8C>, I2CRead<0x72, 2> > ReadChannel0;
+//
+// and executed by ReadChannel0::run(buf). The steps are:
+//
+//   I2CWrite<addr, bytes...>  (repeated) start condition addressing the 8-bit
+//                             address <addr> for writing, then the constant <bytes>
+//   I2CSend<n>                write the next <n> bytes from the buffer
+//   I2CRead<addr, n>          (repeated) start condition addressing <addr> for
+//                             reading, then read <n> bytes into the buffer, the
+//                             last one answered with a NAK
+//
+// The sequence is checked at compile time and is always ended by a stop
+// condition. run returns false as soon as an address or a written byte is not
+// acknowledged (after having sent the stop condition), true otherwise.
+// buffer_size is the number of buffer bytes the transaction reads and writes.
+
+// bus states between two steps
+enum { I2C_TX_IDLE, I2C_TX_WRITING, I2C_TX_READING };
+
+// the constant bytes of I2CWrite
+template<uint8_t... data> struct I2CBytes;
+
+template<> struct I2CBytes<> {
+  static inline __attribute__ ((always_inline)) bool run(void) { return true; }
+};
+
+template<uint8_t first, uint8_t... rest> struct I2CBytes<first, rest...> {
+  static inline __attribute__ ((always_inline)) bool run(void)
+  {
+    return i2c_write(first) && I2CBytes<rest...>::run();
+  }
+};
+
+template<uint8_t addr, uint8_t... data> struct I2CWrite {
+  static_assert((addr & 1) == 0, "I2CWrite: use the 8-bit address with the R/W bit cleared");
+  static const uint8_t state = I2C_TX_WRITING;
+  static const uint8_t buffer_bytes = 0;
+
+  template<uint8_t prev> static inline __attribute__ ((always_inline)) bool run(uint8_t *&)
+  {
+    return (prev == I2C_TX_IDLE ? i2c_start(addr) : i2c_rep_start(addr)) &&
+      I2CBytes<data...>::run();
+  }
+};
+
+template<uint8_t n> struct I2CSend {
+  static_assert(n > 0, "I2CSend: at least one byte has to be sent");
+  static const uint8_t state = I2C_TX_WRITING;
+  static const uint8_t buffer_bytes = n;
+
+  template<uint8_t prev> static inline __attribute__ ((always_inline)) bool run(uint8_t *&buf)
+  {
+    static_assert(prev == I2C_TX_WRITING, "I2CSend has to follow I2CWrite or I2CSend");
+    for (uint8_t i = n; i > 0; i--)
+      if (!i2c_write(*buf++)) return false;
+    return true;
+  }
+};
+
+template<uint8_t addr, uint8_t n> struct I2CRead {
+  static_assert((addr & 1) == 0, "I2CRead: use the 8-bit address with the R/W bit cleared");
+  static_assert(n > 0, "I2CRead: at least one byte has to be read");
+  static const uint8_t state = I2C_TX_READING;
+  static const uint8_t buffer_bytes = n;
+
+  template<uint8_t prev> static inline __attribute__ ((always_inline)) bool run(uint8_t *&buf)
+  {
+    if (!(prev == I2C_TX_IDLE ? i2c_start(addr | 1) : i2c_rep_start(addr | 1)))
+      return false;
+    for (uint8_t i = n; i > 0; i--)
+      *buf++ = i2c_read(i == 1);
+    return true;
+  }
+};
+
+// the steps following a step that left the bus in state <prev>
+template<uint8_t prev, typename... steps> struct I2CSteps;
+
+template<uint8_t prev> struct I2CSteps<prev> {
+  static const uint16_t buffer_size = 0;
+  static inline __attribute__ ((always_inline)) bool run(uint8_t *&) { return true; }
+};
+
+template<uint8_t prev, typename step, typename... rest> struct I2CSteps<prev, step, rest...> {
+  static const uint16_t buffer_size =
+    step::buffer_bytes + I2CSteps<step::state, rest...>::buffer_size;
+
+  static inline __attribute__ ((always_inline)) bool run(uint8_t *&buf)
+  {
+    return step::template run<prev>(buf) && I2CSteps<step::state, rest...>::run(buf);
+  }
+};
+
+template<typename... steps> struct I2CTransaction {
+  static_assert(sizeof...(steps) > 0, "I2CTransaction: no steps given");
+  static const uint16_t buffer_size = I2CSteps<I2C_TX_IDLE, steps...>::buffer_size;
+
+  static bool run(uint8_t *buf = 0)
+  {
+    bool ok = I2CSteps<I2C_TX_IDLE, steps...>::run(buf);
+    i2c_stop();
+    return ok;
+  }
+};
+
+#endif // #ifndef _SoftI2CTransaction_h
+#pragma once